@@ -0,0 +1,51 @@
+#ifndef TINYCC_BENCH_BENCHUTIL_H
+#define TINYCC_BENCH_BENCHUTIL_H
+
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+
+namespace tinycc {
+namespace bench {
+
+/// Runs \p Fn \p Reps times and returns the fastest run in seconds. Taking the
+/// minimum rather than the mean keeps scheduler noise out of the numbers.
+template <typename FnT> double timeBest(unsigned Reps, FnT &&Fn) {
+  double Best = 1e300;
+  for (unsigned I = 0; I != Reps; ++I) {
+    auto Start = std::chrono::steady_clock::now();
+    Fn();
+    std::chrono::duration<double> Elapsed =
+        std::chrono::steady_clock::now() - Start;
+    Best = std::min(Best, Elapsed.count());
+  }
+  return Best;
+}
+
+/// Prints one result row as "<name>  <MB/s>  [<items/s>]".
+inline void report(llvm::StringRef Name, size_t Bytes, double Seconds,
+                   size_t Items = 0, llvm::StringRef ItemName = "") {
+  llvm::outs() << llvm::left_justify(Name, 32)
+               << llvm::format("%10.1f MB/s", Bytes / Seconds / 1e6);
+  if (Items)
+    llvm::outs() << llvm::format("%12.2f M", Items / Seconds / 1e6) << ItemName
+                 << "/s";
+  llvm::outs() << "\n";
+}
+
+/// Keeps the optimizer from discarding a computed value.
+template <typename T> inline void doNotOptimize(const T &Value) {
+#if defined(__GNUC__) || defined(__clang__)
+  asm volatile("" : : "r,m"(Value) : "memory");
+#else
+  static volatile const T *Sink;
+  Sink = &Value;
+#endif
+}
+
+} // namespace bench
+} // namespace tinycc
+
+#endif // TINYCC_BENCH_BENCHUTIL_H
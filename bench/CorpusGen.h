@@ -0,0 +1,121 @@
+#ifndef TINYCC_BENCH_CORPUSGEN_H
+#define TINYCC_BENCH_CORPUSGEN_H
+
+#include <random>
+#include <string>
+
+namespace tinycc {
+namespace bench {
+
+/// Relative weights of the kinds of function a synthetic corpus is built from.
+struct CorpusMix {
+  unsigned Identifiers = 1; ///< Long names, calls and arithmetic.
+  unsigned Numbers = 1;     ///< Decimal, hex, octal and float literals.
+  unsigned Comments = 1;    ///< Line comments and block comment banners.
+};
+
+/// Generates valid tinycc source of about \p Bytes bytes. The output depends
+/// only on the arguments, so runs with the same seed lex the same input.
+class CorpusGenerator {
+  std::mt19937 Rng;
+  std::string Out;
+  unsigned NumFunctions = 0;
+
+  unsigned pick(unsigned N) { return Rng() % N; }
+
+  std::string identifier() {
+    static const char *const Words[] = {"buffer", "index",  "count", "node",
+                                        "value",  "result", "total", "offset",
+                                        "length", "state",  "next",  "prev"};
+    std::string Name = Words[pick(12)];
+    for (unsigned I = 0, E = pick(3); I != E; ++I)
+      Name += std::string("_") + Words[pick(12)];
+    return Name + "_" + std::to_string(pick(1000));
+  }
+
+  std::string hexDigits(unsigned N) {
+    // The lexer only accepts upper-case hex digits.
+    static const char Digits[] = "0123456789ABCDEF";
+    std::string S;
+    for (unsigned I = 0; I != N; ++I)
+      S += Digits[pick(16)];
+    return S;
+  }
+
+  std::string number() {
+    switch (pick(6)) {
+    case 0:
+      return std::to_string(Rng());
+    case 1:
+      return "0x" + hexDigits(1 + pick(8));
+    case 2:
+      return "0" + std::to_string(pick(8)) + std::to_string(pick(8)) +
+             std::to_string(pick(8));
+    case 3:
+      return std::to_string(pick(1000)) + "." + std::to_string(pick(100000));
+    case 4:
+      return std::to_string(pick(10)) + "." + std::to_string(pick(1000)) +
+             (pick(2) ? "e+" : "E-") + std::to_string(pick(30));
+    default:
+      return "0." + std::to_string(pick(100000)) + "e" +
+             std::to_string(pick(30));
+    }
+  }
+
+  void identifierFunction(const std::string &Name) {
+    std::string A = identifier(), B = identifier();
+    Out += "int " + Name + "(int " + A + ", int " + B + ") {\n";
+    for (unsigned I = 0, E = 2 + pick(4); I != E; ++I)
+      Out += "  " + A + " = " + A + " * " + B + " + " + B + " - " + A + ";\n";
+    Out += "  if (" + A + " > " + B + ") {\n    return " + A + ";\n  }\n";
+    Out += "  return " + B + ";\n}\n\n";
+  }
+
+  void numberFunction(const std::string &Name) {
+    Out += "int " + Name + "(int x) {\n";
+    for (unsigned I = 0, E = 2 + pick(4); I != E; ++I) {
+      Out += "  x = x * " + number() + " + " + number() + ";\n";
+      Out += "  x = x - " + number() + " ;\n";
+    }
+    Out += "  return x;\n}\n\n";
+  }
+
+  void commentFunction(const std::string &Name) {
+    Out += "/*";
+    for (unsigned I = 0, E = 3 + pick(6); I != E; ++I)
+      Out += "\n * " + identifier() + ": " + std::string(40 + pick(30), '-');
+    Out += "\n */\n";
+    Out += "int " + Name + "(int x) {\n";
+    for (unsigned I = 0, E = 2 + pick(4); I != E; ++I)
+      Out += "  // " + identifier() + " " + identifier() + " " +
+             std::string(20 + pick(40), '.') + "\n";
+    Out += "  return x; /* trailing note */\n}\n\n";
+  }
+
+public:
+  explicit CorpusGenerator(unsigned Seed = 1) : Rng(Seed) {}
+
+  std::string generate(size_t Bytes, const CorpusMix &Mix) {
+    Out.clear();
+    Out.reserve(Bytes + 4096);
+    unsigned Total = Mix.Identifiers + Mix.Numbers + Mix.Comments;
+    if (Total == 0)
+      return Out;
+    while (Out.size() < Bytes) {
+      std::string Name = "fn_" + std::to_string(NumFunctions++);
+      unsigned R = pick(Total);
+      if (R < Mix.Identifiers)
+        identifierFunction(Name);
+      else if (R < Mix.Identifiers + Mix.Numbers)
+        numberFunction(Name);
+      else
+        commentFunction(Name);
+    }
+    return std::move(Out);
+  }
+};
+
+} // namespace bench
+} // namespace tinycc
+
+#endif // TINYCC_BENCH_CORPUSGEN_H
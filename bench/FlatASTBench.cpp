@@ -0,0 +1,250 @@
+// Compares walking the pointer-based AST against the FlatAST encoding of the
+// same declarations: a hand-written recursive walk over the node classes, a
+// RecursiveASTVisitor walk, a FlatASTVisitor walk and a linear scan over the
+// flat node array. Every walk computes the same per-kind node counts, so the
+// rows do equal work.
+
+#include "AST/FlatAST.h"
+#include "AST/RecursiveASTVisitor.h"
+#include "BenchUtil.h"
+#include "CorpusGen.h"
+#include "Lexer/Lexer.h"
+#include "Parser/Parser.h"
+#include <llvm/Support/CommandLine.h>
+#include <array>
+#include <string>
+
+using namespace tinycc;
+using namespace llvm;
+
+static cl::opt<unsigned> SizeMB("size-mb", cl::desc("Corpus size in MB"),
+                                cl::init(8));
+
+static cl::opt<unsigned> Reps("reps", cl::desc("Repetitions per measurement"),
+                              cl::init(5));
+
+namespace {
+using KindCounts = std::array<size_t, 16>;
+
+// The walk as CodeGenerator does it: switch on the kind, cast, recurse.
+class PointerWalk {
+  KindCounts &Counts;
+
+  void walkExpr(Expr *E) {
+    switch (E->getKind()) {
+    case Expr::EK_Binary:
+      ++Counts[FlatAST::NK_Binary];
+      walkExpr(cast<BinaryExpr>(E)->getLeft());
+      walkExpr(cast<BinaryExpr>(E)->getRight());
+      break;
+    case Expr::EK_Unary:
+      ++Counts[FlatAST::NK_Unary];
+      walkExpr(cast<UnaryExpr>(E)->getSubExpr());
+      break;
+    case Expr::EK_Call:
+      ++Counts[FlatAST::NK_Call];
+      for (Expr *Arg : cast<CallExpr>(E)->getArgs())
+        walkExpr(Arg);
+      break;
+    case Expr::EK_IntegerLiteral:
+      ++Counts[FlatAST::NK_IntegerLiteral];
+      break;
+    case Expr::EK_FloatLiteral:
+      ++Counts[FlatAST::NK_FloatLiteral];
+      break;
+    case Expr::EK_VarRef:
+      ++Counts[FlatAST::NK_VarRef];
+      break;
+    }
+  }
+
+  void walkStmt(Stmt *S) {
+    switch (S->getKind()) {
+    case Stmt::SK_Expr:
+      ++Counts[FlatAST::NK_ExprStmt];
+      walkExpr(cast<ExprStmt>(S)->getExpr());
+      break;
+    case Stmt::SK_Return:
+      ++Counts[FlatAST::NK_ReturnStmt];
+      if (Expr *E = cast<ReturnStmt>(S)->getRetVal())
+        walkExpr(E);
+      break;
+    case Stmt::SK_If: {
+      ++Counts[FlatAST::NK_IfStmt];
+      auto *IS = cast<IfStmt>(S);
+      walkExpr(IS->getCond());
+      walkStmt(IS->getThen());
+      if (IS->getElse())
+        walkStmt(IS->getElse());
+      break;
+    }
+    case Stmt::SK_Compound:
+      ++Counts[FlatAST::NK_CompoundStmt];
+      for (Stmt *Sub : cast<CompoundStmt>(S)->getBody())
+        walkStmt(Sub);
+      break;
+    }
+  }
+
+public:
+  explicit PointerWalk(KindCounts &Counts) : Counts(Counts) {}
+
+  void walk(ArrayRef<Decl *> Decls) {
+    for (Decl *D : Decls) {
+      if (auto *FD = dyn_cast<FunctionDecl>(D)) {
+        ++Counts[FlatAST::NK_Function];
+        Counts[FlatAST::NK_Param] += FD->getParams().size();
+        ++Counts[FlatAST::NK_CompoundStmt];
+        for (Stmt *S : FD->getBody())
+          walkStmt(S);
+      } else {
+        ++Counts[FlatAST::NK_Var];
+        if (Expr *Init = cast<VarDecl>(D)->getInit())
+          walkExpr(Init);
+      }
+    }
+  }
+};
+
+// The same counts through RecursiveASTVisitor.
+class CountingASTVisitor : public RecursiveASTVisitor<CountingASTVisitor> {
+  KindCounts &Counts;
+
+public:
+  explicit CountingASTVisitor(KindCounts &Counts) : Counts(Counts) {}
+
+  bool visitFunctionDecl(FunctionDecl *) {
+    // The flat encoding gives every function a CompoundStmt body.
+    ++Counts[FlatAST::NK_Function];
+    ++Counts[FlatAST::NK_CompoundStmt];
+    return true;
+  }
+  bool visitParamDecl(ParamDecl *) {
+    ++Counts[FlatAST::NK_Param];
+    return true;
+  }
+  bool visitVarDecl(VarDecl *) {
+    ++Counts[FlatAST::NK_Var];
+    return true;
+  }
+  bool visitExprStmt(ExprStmt *) {
+    ++Counts[FlatAST::NK_ExprStmt];
+    return true;
+  }
+  bool visitReturnStmt(ReturnStmt *) {
+    ++Counts[FlatAST::NK_ReturnStmt];
+    return true;
+  }
+  bool visitIfStmt(IfStmt *) {
+    ++Counts[FlatAST::NK_IfStmt];
+    return true;
+  }
+  bool visitCompoundStmt(CompoundStmt *) {
+    ++Counts[FlatAST::NK_CompoundStmt];
+    return true;
+  }
+  bool visitIntegerLiteral(IntegerLiteral *) {
+    ++Counts[FlatAST::NK_IntegerLiteral];
+    return true;
+  }
+  bool visitFloatLiteral(FloatLiteral *) {
+    ++Counts[FlatAST::NK_FloatLiteral];
+    return true;
+  }
+  bool visitVarRefExpr(VarRefExpr *) {
+    ++Counts[FlatAST::NK_VarRef];
+    return true;
+  }
+  bool visitBinaryExpr(BinaryExpr *) {
+    ++Counts[FlatAST::NK_Binary];
+    return true;
+  }
+  bool visitUnaryExpr(UnaryExpr *) {
+    ++Counts[FlatAST::NK_Unary];
+    return true;
+  }
+  bool visitCallExpr(CallExpr *) {
+    ++Counts[FlatAST::NK_Call];
+    return true;
+  }
+};
+
+class CountingVisitor : public FlatASTVisitor<CountingVisitor> {
+  KindCounts &Counts;
+
+public:
+  CountingVisitor(const FlatAST &AST, KindCounts &Counts)
+      : FlatASTVisitor(AST), Counts(Counts) {}
+
+#define FLAT_NODE(Name)                                                        \
+  bool visit##Name(uint32_t) {                                                 \
+    ++Counts[FlatAST::NK_##Name];                                              \
+    return true;                                                               \
+  }
+#include "AST/FlatNodes.def"
+};
+} // namespace
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "tinycc flat AST benchmark\n");
+
+  bench::CorpusGenerator Gen;
+  std::string Corpus =
+      Gen.generate(static_cast<size_t>(SizeMB) << 20, bench::CorpusMix());
+  SourceMgr SrcMgr;
+  DiagnosticsEngine Diags(SrcMgr);
+  IdentifierTable Idents;
+  SrcMgr.AddNewSourceBuffer(MemoryBuffer::getMemBuffer(Corpus, "<corpus>"),
+                            SMLoc());
+  Lexer Lex(SrcMgr, Diags, Idents);
+  TokenStream Tokens;
+  Lex.lexAll(Tokens);
+  ASTContext Ctx;
+  Parser P(Lex, Tokens, Diags, Ctx);
+  DeclList Decls = P.parse();
+
+  FlatAST Flat;
+  double Secs = bench::timeBest(Reps, [&] { Flat = FlatAST::build(Decls); });
+  size_t NumNodes = Flat.size();
+  bench::report("convert to flat", Corpus.size(), Secs, NumNodes, "node");
+
+  KindCounts Expected{};
+  Secs = bench::timeBest(Reps, [&] {
+    KindCounts Counts{};
+    PointerWalk(Counts).walk(Decls);
+    Expected = Counts;
+  });
+  bench::report("pointer AST walk", Corpus.size(), Secs, NumNodes, "node");
+
+  Secs = bench::timeBest(Reps, [&] {
+    KindCounts Counts{};
+    CountingASTVisitor(Counts).traverseAST(Decls);
+    if (Counts != Expected)
+      errs() << "RecursiveASTVisitor counts differ from the pointer AST\n";
+  });
+  bench::report("RecursiveASTVisitor walk", Corpus.size(), Secs, NumNodes,
+                "node");
+
+  Secs = bench::timeBest(Reps, [&] {
+    KindCounts Counts{};
+    CountingVisitor(Flat, Counts).traverseAST();
+    if (Counts != Expected)
+      errs() << "flat visitor counts differ from the pointer AST\n";
+  });
+  bench::report("FlatASTVisitor walk", Corpus.size(), Secs, NumNodes, "node");
+
+  Secs = bench::timeBest(Reps, [&] {
+    KindCounts Counts{};
+    for (const FlatAST::Node &N : Flat.nodes())
+      ++Counts[N.Kind];
+    if (Counts != Expected)
+      errs() << "flat scan counts differ from the pointer AST\n";
+  });
+  bench::report("flat node scan", Corpus.size(), Secs, NumNodes, "node");
+
+  outs() << left_justify("pointer AST memory", 32)
+         << format("%10.1f MB\n", Ctx.getBytesAllocated() / 1048576.0);
+  outs() << left_justify("flat AST memory", 32)
+         << format("%10.1f MB\n", Flat.getMemorySize() / 1048576.0);
+  return 0;
+}
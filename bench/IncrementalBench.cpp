@@ -0,0 +1,115 @@
+// Compares a full lex+parse of a large buffer with the latency of re-parsing it
+// through IncrementalParser after small edits, and checks that the incremental
+// result matches a full re-parse of the edited text.
+
+#include "BenchUtil.h"
+#include "Parser/IncrementalParser.h"
+#include <llvm/Support/CommandLine.h>
+#include <string>
+
+using namespace tinycc;
+using namespace llvm;
+
+static cl::opt<unsigned> NumFunctions("functions",
+                                      cl::desc("Functions in the corpus"),
+                                      cl::init(10000));
+
+static cl::opt<unsigned> NumEdits("edits", cl::desc("Edits to apply"),
+                                  cl::init(20));
+
+static cl::opt<unsigned> Reps("reps", cl::desc("Repetitions per measurement"),
+                              cl::init(3));
+
+// Ten lines per function, so the default corpus is 100k lines.
+static std::string makeCorpus(unsigned N) {
+  std::string Corpus;
+  for (unsigned I = 0; I != N; ++I) {
+    std::string Name = "function_" + std::to_string(I);
+    Corpus += "int " + Name + "(int lhs, int rhs) {\n"
+              "  int tmp;\n"
+              "  tmp = lhs * rhs + lhs / rhs - (lhs + rhs);\n"
+              "  if (tmp > lhs) {\n"
+              "    return tmp;\n"
+              "  } else {\n"
+              "    return rhs;\n"
+              "  }\n"
+              "  return 0;\n"
+              "}\n";
+  }
+  return Corpus;
+}
+
+static bool sameResult(const IncrementalParser &Inc, StringRef Text) {
+  SourceMgr SrcMgr;
+  IdentifierTable Idents;
+  IncrementalParser Full(SrcMgr, Idents);
+  if (!Full.parse(Text))
+    return false;
+
+  TokenStream A = Inc.getTokens(), B = Full.getTokens();
+  if (A.kinds() != B.kinds() || A.offsets() != B.offsets() ||
+      A.lengths() != B.lengths())
+    return false;
+  DeclList IncDecls = Inc.getDecls(), FullDecls = Full.getDecls();
+  if (IncDecls.size() != FullDecls.size())
+    return false;
+  for (size_t I = 0, E = IncDecls.size(); I != E; ++I)
+    if (IncDecls[I]->getName() != FullDecls[I]->getName())
+      return false;
+  return true;
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "tinycc incremental parse benchmark\n");
+
+  std::string Corpus = makeCorpus(NumFunctions);
+  SourceMgr SrcMgr;
+  IdentifierTable Idents;
+
+  double Secs = bench::timeBest(Reps, [&] {
+    IncrementalParser Inc(SrcMgr, Idents);
+    Inc.parse(Corpus);
+    bench::doNotOptimize(Inc.getNumDecls());
+  });
+  bench::report("full lex+parse", Corpus.size(), Secs);
+
+  // Flip one operator in a function body, then insert a whole new function,
+  // each at a different spot in the buffer.
+  IncrementalParser Inc(SrcMgr, Idents);
+  Inc.parse(Corpus);
+  IncrementalParser::Stats Total;
+  double EditSecs = 0;
+  bool Ok = true;
+  for (unsigned I = 0; I != NumEdits; ++I) {
+    std::string Text = Inc.getText();
+    size_t Pos = Text.find("lhs * rhs", Text.size() / (NumEdits + 1) * I);
+    TextEdit Edit;
+    if (I % 2 == 0) {
+      Edit.Offset = Pos + 4;
+      Edit.RemovedLength = 1;
+      Edit.Inserted = "-";
+    } else {
+      Edit.Offset = Text.find("\n}\n", Pos) + 3;
+      Edit.Inserted = "int inserted(int x) { return x * 2; }\n";
+    }
+
+    bool Applied = false;
+    EditSecs += bench::timeBest(1, [&] { Applied = Inc.applyEdit(Edit); });
+    Ok &= Applied;
+    const IncrementalParser::Stats &S = Inc.getLastStats();
+    Total.TokensRelexed += S.TokensRelexed;
+    Total.DeclsReparsed += S.DeclsReparsed;
+    Total.DeclsReused += S.DeclsReused;
+    Ok &= sameResult(Inc, Inc.getText());
+  }
+
+  outs() << left_justify("incremental edit", 32)
+         << format("%10.1f us/edit", EditSecs / NumEdits * 1e6)
+         << format("%10.1fx vs full\n", Secs / (EditSecs / NumEdits));
+  outs() << "  per edit: " << Total.TokensRelexed / NumEdits
+         << " tokens re-lexed, " << Total.DeclsReparsed / NumEdits
+         << " decls re-parsed, " << Total.DeclsReused / NumEdits
+         << " decls reused\n";
+  outs() << "  matches full re-parse: " << (Ok ? "yes" : "NO") << "\n";
+  return Ok ? 0 : 1;
+}
@@ -0,0 +1,127 @@
+// Compares keyword recognition through the compile-time perfect hash in
+// Support/KeywordTable.h against the llvm::StringMap the lexer used to build
+// in every constructor, and the parser's miscased keyword check through the
+// same table against the scan over all keywords it used to do.
+
+#include "BenchUtil.h"
+#include "Lexer/Lexer.h"
+#include "Support/KeywordTable.h"
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Support/CommandLine.h>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace tinycc;
+using namespace llvm;
+
+static cl::opt<unsigned> NumWords("words",
+                                  cl::desc("Number of identifiers to look up"),
+                                  cl::init(4000000));
+
+static cl::opt<unsigned> Reps("reps", cl::desc("Repetitions per measurement"),
+                              cl::init(5));
+
+namespace {
+// The StringMap based filter as it was before the perfect hash.
+class StringMapKeywordFilter {
+  StringMap<tok::TokenKind> HashTable;
+
+public:
+  void addKeywords() {
+#define KEYWORD(NAME, FLAGS)                                                   \
+  HashTable.insert(std::make_pair(StringRef(#NAME), tok::kw_##NAME));
+#include "Support/TokenKinds.def"
+  }
+
+  tok::TokenKind getKeyword(StringRef Name, tok::TokenKind Default) {
+    auto Result = HashTable.find(Name);
+    if (Result != HashTable.end())
+      return Result->second;
+    return Default;
+  }
+};
+
+// The miscased keyword check as it was before the folded lookup.
+tok::TokenKind scanMiscasedKeyword(StringRef Id) {
+  for (tok::TokenKind K = tok::kw_start; K <= tok::kw_end;
+       K = static_cast<tok::TokenKind>(K + 1)) {
+    const char *KwSpelling = tok::getKeywordSpelling(K);
+    if (KwSpelling && Id.equals_insensitive(KwSpelling) && Id != KwSpelling)
+      return K;
+  }
+  return tok::unknown;
+}
+} // namespace
+
+// Roughly one keyword in five and a few miscased ones, the rest short and long
+// identifiers, some of which share a length and first letter with a keyword.
+static std::vector<std::string> makeCorpus(unsigned N) {
+  static const char *const Words[] = {
+      "int",    "return",   "if",         "else",    "void",
+      "float",  "i",        "idx",        "insert",  "result",
+      "value",  "elsewise", "first_item", "counter", "tmp",
+      "buffer", "fl",       "vector_len", "end_ptr", "generated_symbol_42",
+      "Int",    "RETURN",   "Else",       "iF",      "Value"};
+  std::mt19937 Rng(42);
+  std::uniform_int_distribution<unsigned> Pick(
+      0, sizeof(Words) / sizeof(Words[0]) - 1);
+  std::vector<std::string> Corpus;
+  Corpus.reserve(N);
+  for (unsigned I = 0; I != N; ++I)
+    Corpus.push_back(Words[Pick(Rng)]);
+  return Corpus;
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "tinycc keyword lookup benchmark\n");
+
+  std::vector<std::string> Corpus = makeCorpus(NumWords);
+  size_t Bytes = 0;
+  for (const std::string &W : Corpus)
+    Bytes += W.size();
+
+  double Secs = bench::timeBest(Reps, [&] {
+    StringMapKeywordFilter Filter;
+    Filter.addKeywords();
+    bench::doNotOptimize(Filter);
+  });
+  outs() << left_justify("StringMap build", 32)
+         << format("%10.0f ns\n", Secs * 1e9);
+
+  StringMapKeywordFilter Filter;
+  Filter.addKeywords();
+  Secs = bench::timeBest(Reps, [&] {
+    unsigned Hits = 0;
+    for (const std::string &W : Corpus)
+      Hits += Filter.getKeyword(W, tok::identifier) != tok::identifier;
+    bench::doNotOptimize(Hits);
+  });
+  bench::report("StringMap lookup", Bytes, Secs, Corpus.size(), "id");
+
+  Secs = bench::timeBest(Reps, [&] {
+    unsigned Hits = 0;
+    for (const std::string &W : Corpus)
+      Hits += tok::getKeywordKind(W, tok::identifier) != tok::identifier;
+    bench::doNotOptimize(Hits);
+  });
+  bench::report("perfect hash lookup", Bytes, Secs, Corpus.size(), "id");
+
+  Secs = bench::timeBest(Reps, [&] {
+    unsigned Hits = 0;
+    for (const std::string &W : Corpus)
+      Hits += scanMiscasedKeyword(W) != tok::unknown;
+    bench::doNotOptimize(Hits);
+  });
+  bench::report("miscase check (scan)", Bytes, Secs, Corpus.size(), "id");
+
+  KeywordFilter Keywords;
+  Secs = bench::timeBest(Reps, [&] {
+    unsigned Hits = 0;
+    for (const std::string &W : Corpus)
+      Hits += Keywords.getMiscasedKeyword(W) != tok::unknown;
+    bench::doNotOptimize(Hits);
+  });
+  bench::report("miscase check (folded)", Bytes, Secs, Corpus.size(), "id");
+  return 0;
+}
@@ -0,0 +1,105 @@
+// Measures lexer throughput on synthetic corpora: identifier-heavy,
+// number-heavy, comment-heavy and a mix of all three. Each corpus is lexed with
+// Lexer::next in a loop and with Lexer::getAllTokens.
+
+#include "BenchUtil.h"
+#include "CorpusGen.h"
+#include "Lexer/Lexer.h"
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Support/CommandLine.h>
+#include <string>
+
+using namespace tinycc;
+using namespace llvm;
+
+static cl::opt<unsigned> SizeMB("size-mb", cl::desc("Corpus size in MB"),
+                                cl::init(16));
+
+static cl::opt<unsigned> Reps("reps", cl::desc("Repetitions per measurement"),
+                              cl::init(5));
+
+static cl::opt<unsigned> Seed("seed", cl::desc("Corpus generator seed"),
+                              cl::init(1));
+
+static cl::list<std::string>
+    Corpora("corpus", cl::CommaSeparated,
+            cl::desc("Corpora to run: ident, number, comment, mixed, custom "
+                     "(default: all but custom)"));
+
+static cl::opt<std::string>
+    CustomMix("mix", cl::desc("Weights of the custom corpus as "
+                              "<ident>,<number>,<comment>"),
+              cl::init("1,1,1"));
+
+static cl::opt<std::string>
+    DumpDir("dump-corpus",
+            cl::desc("Write each corpus to <dir>/<name>.c for use with tinycc"),
+            cl::value_desc("dir"));
+
+static bool parseMix(StringRef Spec, bench::CorpusMix &Mix) {
+  SmallVector<StringRef, 3> Parts;
+  Spec.split(Parts, ',');
+  return Parts.size() == 3 && !Parts[0].getAsInteger(10, Mix.Identifiers) &&
+         !Parts[1].getAsInteger(10, Mix.Numbers) &&
+         !Parts[2].getAsInteger(10, Mix.Comments);
+}
+
+static void runCorpus(const std::string &Name, const bench::CorpusMix &Mix) {
+  bench::CorpusGenerator Gen(Seed);
+  std::string Corpus = Gen.generate(static_cast<size_t>(SizeMB) << 20, Mix);
+
+  if (!DumpDir.empty()) {
+    std::error_code EC;
+    raw_fd_ostream OS(DumpDir + "/" + Name + ".c", EC);
+    if (EC)
+      errs() << "cannot write corpus: " << EC.message() << "\n";
+    else
+      OS << Corpus;
+  }
+
+  size_t NumTokens = 0;
+  double Secs = bench::timeBest(Reps, [&] {
+    Lexer Lex(Corpus);
+    Token Tok;
+    NumTokens = 0;
+    do {
+      Lex.next(Tok);
+      ++NumTokens;
+    } while (!Tok.is(tok::eof));
+  });
+  bench::report(Name + " Lexer::next", Corpus.size(), Secs, NumTokens, "tok");
+
+  Secs = bench::timeBest(Reps, [&] {
+    Lexer Lex(Corpus);
+    std::vector<Token> Tokens = Lex.getAllTokens();
+    bench::doNotOptimize(Tokens);
+  });
+  bench::report(Name + " getAllTokens", Corpus.size(), Secs, NumTokens,
+                "tok");
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "tinycc lexer benchmark\n");
+
+  std::vector<std::string> Names(Corpora.begin(), Corpora.end());
+  if (Names.empty())
+    Names = {"ident", "number", "comment", "mixed"};
+
+  for (const std::string &Name : Names) {
+    bench::CorpusMix Mix;
+    if (Name == "ident")
+      Mix = {1, 0, 0};
+    else if (Name == "number")
+      Mix = {0, 1, 0};
+    else if (Name == "comment")
+      Mix = {0, 0, 1};
+    else if (Name == "mixed")
+      Mix = {1, 1, 1};
+    else if (Name != "custom" || !parseMix(CustomMix, Mix)) {
+      errs() << "unknown corpus or bad --mix: " << Name << "\n";
+      return 1;
+    }
+    runCorpus(Name, Mix);
+  }
+  return 0;
+}
@@ -0,0 +1,97 @@
+// Measures the character scanning kernels from Lexer/CharScan.h on each
+// instruction set the host supports. The scalar rows are the byte-at-a-time
+// loops the lexer used before the vector kernels existed.
+
+#include "BenchUtil.h"
+#include "Lexer/CharScan.h"
+#include "Lexer/Lexer.h"
+#include <llvm/Support/CommandLine.h>
+#include <string>
+
+using namespace tinycc;
+using namespace llvm;
+
+static cl::opt<unsigned> SizeMB("size-mb", cl::desc("Corpus size in MB"),
+                                cl::init(16));
+
+static cl::opt<unsigned> Reps("reps", cl::desc("Repetitions per measurement"),
+                              cl::init(5));
+
+// A mix of comment banners, deep indentation and long identifiers, the shape
+// of the generated sources the vector kernels are aimed at. Numbers are left
+// out so only the scanning paths are measured.
+static std::string makeCorpus(size_t Bytes) {
+  static const char *const Chunk =
+      "/*****************************************************************\n"
+      " * Generated file. Do not edit. The banner below is intentionally \n"
+      " * long so that comment scanning dominates this section.          \n"
+      " *****************************************************************/\n"
+      "int generated_function_with_a_long_name(int first_argument_value,\n"
+      "                                        int second_argument_value) {\n"
+      "        // Trailing line comments are common in generated code too.\n"
+      "        if (first_argument_value > second_argument_value) {\n"
+      "                return first_argument_value;\n"
+      "        }\n"
+      "        return second_argument_value + first_argument_value;\n"
+      "}\n\n";
+  std::string Corpus;
+  Corpus.reserve(Bytes + 1024);
+  while (Corpus.size() < Bytes)
+    Corpus += Chunk;
+  return Corpus;
+}
+
+template <typename FnT>
+static void runKernel(StringRef Name, StringRef Input, FnT Kernel) {
+  const char *End = Input.end();
+  double Secs = bench::timeBest(Reps, [&] {
+    const char *P = Kernel(Input.begin(), End);
+    bench::doNotOptimize(P);
+  });
+  bench::report(Name, Input.size(), Secs);
+}
+
+static void runLexer(StringRef Name, StringRef Input) {
+  size_t NumTokens = 0;
+  double Secs = bench::timeBest(Reps, [&] {
+    Lexer Lex(Input);
+    Token Tok;
+    NumTokens = 0;
+    do {
+      Lex.next(Tok);
+      ++NumTokens;
+    } while (!Tok.is(tok::eof));
+  });
+  bench::report(Name, Input.size(), Secs, NumTokens, "tok");
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "tinycc scanning benchmark\n");
+
+  size_t Bytes = static_cast<size_t>(SizeMB) << 20;
+  std::string Whitespace(Bytes, ' ');
+  for (size_t I = 80; I < Whitespace.size(); I += 81)
+    Whitespace[I] = '\n';
+  Whitespace.push_back('x');
+  std::string Identifier(Bytes, 'a');
+  for (size_t I = 0; I < Identifier.size(); I += 7)
+    Identifier[I] = '_';
+  Identifier.push_back(';');
+  std::string Comment(Bytes, '*');
+  Comment += "*/";
+  std::string Corpus = makeCorpus(Bytes);
+
+  for (scan::ISA Kind : {scan::ISA::Scalar, scan::ISA::SSE2, scan::ISA::AVX2}) {
+    if (scan::setISA(Kind) != Kind)
+      continue;
+    std::string Suffix = std::string(" [") + scan::getISAName(Kind) + "]";
+    runKernel("skipWhitespace" + Suffix, Whitespace,
+              scan::detail::skipWhitespace);
+    runKernel("skipIdentifierBody" + Suffix, Identifier,
+              scan::detail::skipIdentifierBody);
+    runKernel("findBlockCommentEnd" + Suffix, Comment,
+              scan::detail::findBlockCommentEnd);
+    runLexer("Lexer::next" + Suffix, Corpus);
+  }
+  return 0;
+}
@@ -0,0 +1,115 @@
+// Compares parsing with the lexer running in lockstep (Parser pulling tokens
+// through Lexer::next) against lexing into a TokenStream first and parsing from
+// that. The last rows time parsing alone: in full, with the function bodies
+// parsed in parallel, and in lazy-body mode, which only indexes the top-level
+// declarations.
+
+#include "BenchUtil.h"
+#include "Lexer/Lexer.h"
+#include "Parser/Parser.h"
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/Parallel.h>
+#include <string>
+
+using namespace tinycc;
+using namespace llvm;
+
+static cl::opt<unsigned> NumFunctions("functions",
+                                      cl::desc("Functions in the corpus"),
+                                      cl::init(50000));
+
+static cl::opt<unsigned> Reps("reps", cl::desc("Repetitions per measurement"),
+                              cl::init(5));
+
+static cl::opt<unsigned> Threads("threads",
+                                 cl::desc("Worker threads (default: one per "
+                                          "core)"),
+                                 cl::init(0));
+
+static std::string makeCorpus(unsigned N) {
+  std::string Corpus;
+  for (unsigned I = 0; I != N; ++I) {
+    std::string Name = "function_" + std::to_string(I);
+    Corpus += "int " + Name + "(int lhs, int rhs) {\n"
+              "  int tmp;\n"
+              "  tmp = lhs * rhs + lhs / rhs - (lhs + rhs);\n"
+              "  if (tmp > lhs) {\n"
+              "    return tmp;\n"
+              "  } else {\n"
+              "    return rhs;\n"
+              "  }\n"
+              "}\n";
+  }
+  return Corpus;
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "tinycc token stream benchmark\n");
+  if (Threads)
+    parallel::strategy = hardware_concurrency(Threads);
+
+  std::string Corpus = makeCorpus(NumFunctions);
+  SourceMgr SrcMgr;
+  DiagnosticsEngine Diags(SrcMgr);
+  size_t NumTokens = 0;
+
+  double Secs = bench::timeBest(Reps, [&] {
+    Lexer Lex(Corpus);
+    TokenStream Tokens;
+    Lex.lexAll(Tokens);
+    NumTokens = Tokens.size();
+    bench::doNotOptimize(Tokens);
+  });
+  bench::report("lexAll", Corpus.size(), Secs, NumTokens, "tok");
+
+  Secs = bench::timeBest(Reps, [&] {
+    Lexer Lex(Corpus);
+    TokenStream Tokens;
+    Lex.lexAllParallel(Tokens);
+    bench::doNotOptimize(Tokens);
+  });
+  bench::report("lexAllParallel", Corpus.size(), Secs, NumTokens, "tok");
+
+  Secs = bench::timeBest(Reps, [&] {
+    Lexer Lex(Corpus);
+    ASTContext Ctx;
+    Parser P(Lex, Diags, Ctx);
+    auto Decls = P.parse();
+    bench::doNotOptimize(Decls);
+  });
+  bench::report("interleaved lex+parse", Corpus.size(), Secs, NumTokens,
+                "tok");
+
+  Secs = bench::timeBest(Reps, [&] {
+    Lexer Lex(Corpus);
+    TokenStream Tokens;
+    Lex.lexAll(Tokens);
+    ASTContext Ctx;
+    Parser P(Lex, Tokens, Diags, Ctx);
+    auto Decls = P.parse();
+    bench::doNotOptimize(Decls);
+  });
+  bench::report("token stream lex+parse", Corpus.size(), Secs, NumTokens,
+                "tok");
+
+  // Parsing alone, from a stream lexed up front.
+  Lexer Lex(Corpus);
+  TokenStream Tokens;
+  Lex.lexAll(Tokens);
+  enum { Serial, Parallel, Lazy };
+  for (int Mode : {Serial, Parallel, Lazy}) {
+    Secs = bench::timeBest(Reps, [&] {
+      ASTContext Ctx;
+      Parser P(Lex, Tokens, Diags, Ctx);
+      P.setParallelBodies(Mode == Parallel);
+      P.setLazyBodies(Mode == Lazy);
+      auto Decls = P.parse();
+      bench::doNotOptimize(Decls);
+    });
+    const char *Name = Mode == Serial     ? "parse"
+                       : Mode == Parallel ? "parse (parallel bodies)"
+                                          : "index (lazy bodies)";
+    bench::report(Name, Corpus.size(), Secs, NumTokens, "tok");
+  }
+  return 0;
+}
@@ -1,11 +1,18 @@
 #ifndef TINYCC_AST_AST_H
 #define TINYCC_AST_AST_H
 
+#include "AST/ASTContext.h"
+#include "Support/IdentifierTable.h"
 #include "Support/TokenKinds.h"
 #include "llvm/ADT/APSInt.h"
 #include "llvm/ADT/APFloat.h"
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/SMLoc.h"
+#include "llvm/Support/TrailingObjects.h"
+#include <cassert>
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -17,11 +24,9 @@ class Expr;
 class Stmt;
 
 using DeclList = std::vector<Decl *>;
-using ExprList = std::vector<Expr *>;
-using StmtList = std::vector<Stmt *>;
 
 // Base class for all declarations
-class Decl {
+class Decl : public ASTNode {
 public:
   enum DeclKind { DK_Function, DK_Var };
 
@@ -30,16 +35,16 @@ private:
 
 protected:
   SMLoc Loc;
-  StringRef Name;
+  IdentifierInfo *Name;
 
 public:
-  Decl(DeclKind Kind, SMLoc Loc, StringRef Name)
+  Decl(DeclKind Kind, SMLoc Loc, IdentifierInfo *Name)
       : Kind(Kind), Loc(Loc), Name(Name) {}
-  virtual ~Decl() = default;
 
   DeclKind getKind() const { return Kind; }
   SMLoc getLocation() const { return Loc; }
-  StringRef getName() const { return Name; }
+  IdentifierInfo *getIdentifier() const { return Name; }
+  StringRef getName() const { return Name->getName(); }
 };
 
 // Function parameter declaration
@@ -48,30 +53,118 @@ class ParamDecl : public Decl {
   StringRef Type;
 
 public:
-  ParamDecl(SMLoc Loc, StringRef Name, StringRef Type)
+  ParamDecl(SMLoc Loc, IdentifierInfo *Name, StringRef Type)
       : Decl(DK_Var, Loc, Name), Type(Type) {}
 
   StringRef getType() const { return Type; }
 };
 
-using ParamList = std::vector<ParamDecl *>;
+// Parses function bodies that were skipped when their FunctionDecl was
+// created, e.g. by Parser in lazy-body mode.
+class LazyBodySource {
+public:
+  virtual ~LazyBodySource() = default;
+
+  // Returns the statements of the body spanning tokens [Begin, End).
+  virtual ArrayRef<Stmt *> parseBody(uint32_t Begin, uint32_t End) = 0;
+};
+
+// A function body that is parsed the first time it is asked for.
+class LazyFunctionBody {
+  LazyBodySource *Source;
+  uint32_t Begin;
+  uint32_t End;
+  bool Parsed = false;
+  ArrayRef<Stmt *> Stmts;
+
+public:
+  LazyFunctionBody(LazyBodySource *Source, uint32_t Begin, uint32_t End)
+      : Source(Source), Begin(Begin), End(End) {}
+
+  uint32_t getBeginToken() const { return Begin; }
+  uint32_t getEndToken() const { return End; }
+  bool isParsed() const { return Parsed; }
+
+  ArrayRef<Stmt *> get() {
+    if (!Parsed)
+      set(Source->parseBody(Begin, End));
+    return Stmts;
+  }
+
+  // Stores a body parsed elsewhere, e.g. by a parser worker thread.
+  void set(ArrayRef<Stmt *> Body) {
+    Stmts = Body;
+    Parsed = true;
+  }
+};
+
+// Function declaration. The parameters and body statements are stored
+// inline after the node, unless the body is parsed lazily.
+class FunctionDecl final
+    : public Decl,
+      private llvm::TrailingObjects<FunctionDecl, ParamDecl *, Stmt *> {
+  friend TrailingObjects;
 
-// Function declaration
-class FunctionDecl : public Decl {
-  ParamList Params;
   StringRef ReturnType;
-  StmtList Body;
+  unsigned NumParams;
+  unsigned NumBodyStmts;
+  LazyFunctionBody *LazyBody;
+
+  FunctionDecl(SMLoc Loc, IdentifierInfo *Name, StringRef ReturnType,
+               ArrayRef<ParamDecl *> Params, ArrayRef<Stmt *> Body,
+               LazyFunctionBody *LazyBody)
+      : Decl(DK_Function, Loc, Name), ReturnType(ReturnType),
+        NumParams(Params.size()), NumBodyStmts(Body.size()),
+        LazyBody(LazyBody) {
+    std::uninitialized_copy(Params.begin(), Params.end(),
+                            getTrailingObjects<ParamDecl *>());
+    std::uninitialized_copy(Body.begin(), Body.end(),
+                            getTrailingObjects<Stmt *>());
+  }
+
+  size_t numTrailingObjects(OverloadToken<ParamDecl *>) const {
+    return NumParams;
+  }
 
 public:
-  FunctionDecl(SMLoc Loc, StringRef Name, StringRef ReturnType,
-               ParamList Params)
-      : Decl(DK_Function, Loc, Name), Params(Params), ReturnType(ReturnType) {}
+  // An empty Body means the function is only declared.
+  static FunctionDecl *Create(ASTContext &C, SMLoc Loc, IdentifierInfo *Name,
+                              StringRef ReturnType,
+                              ArrayRef<ParamDecl *> Params,
+                              ArrayRef<Stmt *> Body) {
+    void *Mem = C.Allocate(
+        totalSizeToAlloc<ParamDecl *, Stmt *>(Params.size(), Body.size()),
+        alignof(FunctionDecl));
+    return new (Mem)
+        FunctionDecl(Loc, Name, ReturnType, Params, Body, nullptr);
+  }
+
+  // Creates a function whose body is parsed on the first getBody() call.
+  static FunctionDecl *CreateLazy(ASTContext &C, SMLoc Loc,
+                                  IdentifierInfo *Name, StringRef ReturnType,
+                                  ArrayRef<ParamDecl *> Params,
+                                  LazyFunctionBody *Body) {
+    void *Mem = C.Allocate(totalSizeToAlloc<ParamDecl *, Stmt *>(
+                               Params.size(), 0),
+                           alignof(FunctionDecl));
+    return new (Mem) FunctionDecl(Loc, Name, ReturnType, Params, {}, Body);
+  }
 
-  const ParamList &getParams() const { return Params; }
+  ArrayRef<ParamDecl *> getParams() const {
+    return {getTrailingObjects<ParamDecl *>(), NumParams};
+  }
   StringRef getReturnType() const { return ReturnType; }
 
-  void setBody(StmtList Body) { this->Body = Body; }
-  const StmtList &getBody() const { return Body; }
+  // Parses a lazy body if it hasn't been yet, so this is not safe to call
+  // concurrently for the same function.
+  ArrayRef<Stmt *> getBody() const {
+    if (LazyBody)
+      return LazyBody->get();
+    return {getTrailingObjects<Stmt *>(), NumBodyStmts};
+  }
+
+  // The pending body of a function parsed in lazy-body mode, or null.
+  LazyFunctionBody *getLazyBody() const { return LazyBody; }
 
   static bool classof(const Decl *D) { return D->getKind() == DK_Function; }
 };
@@ -82,7 +175,8 @@ class VarDecl : public Decl {
   Expr *Init; // Optional initializer
 
 public:
-  VarDecl(SMLoc Loc, StringRef Name, StringRef Type, Expr *Init = nullptr)
+  VarDecl(SMLoc Loc, IdentifierInfo *Name, StringRef Type,
+          Expr *Init = nullptr)
       : Decl(DK_Var, Loc, Name), Type(Type), Init(Init) {}
 
   StringRef getType() const { return Type; }
@@ -93,7 +187,7 @@ public:
 };
 
 // Base class for all expressions
-class Expr {
+class Expr : public ASTNode {
 public:
   enum ExprKind { EK_Binary, EK_Unary, EK_IntegerLiteral, EK_FloatLiteral, EK_VarRef, EK_Call };
 
@@ -105,8 +199,6 @@ protected:
   Expr(ExprKind Kind, SMLoc Loc) : Kind(Kind), Loc(Loc) {}
 
 public:
-  virtual ~Expr() = default;
-
   ExprKind getKind() const { return Kind; }
   SMLoc getLocation() const { return Loc; }
 };
@@ -116,8 +208,12 @@ class IntegerLiteral : public Expr {
   llvm::APSInt Value;
 
 public:
+  // Destructors of AST nodes don't run, so the value must fit APInt's inline
+  // storage.
   IntegerLiteral(SMLoc Loc, const llvm::APSInt &Value)
-      : Expr(EK_IntegerLiteral, Loc), Value(Value) {}
+      : Expr(EK_IntegerLiteral, Loc), Value(Value) {
+    assert(Value.getBitWidth() <= 64 && "literal would leak its storage");
+  }
 
   const llvm::APSInt &getValue() const { return Value; }
 
@@ -143,12 +239,14 @@ public:
 
 // Variable reference expression
 class VarRefExpr : public Expr {
-  StringRef Name;
+  IdentifierInfo *Name;
 
 public:
-  VarRefExpr(SMLoc Loc, StringRef Name) : Expr(EK_VarRef, Loc), Name(Name) {}
+  VarRefExpr(SMLoc Loc, IdentifierInfo *Name)
+      : Expr(EK_VarRef, Loc), Name(Name) {}
 
-  StringRef getName() const { return Name; }
+  IdentifierInfo *getIdentifier() const { return Name; }
+  StringRef getName() const { return Name->getName(); }
 
   static bool classof(const Expr *E) { return E->getKind() == EK_VarRef; }
 };
@@ -170,6 +268,8 @@ public:
   BinaryOpKind getOpcode() const { return Op; }
   Expr *getLeft() const { return Left; }
   Expr *getRight() const { return Right; }
+  void setLeft(Expr *E) { Left = E; }
+  void setRight(Expr *E) { Right = E; }
 
   static bool classof(const Expr *E) { return E->getKind() == EK_Binary; }
 };
@@ -189,27 +289,48 @@ public:
 
   UnaryOpKind getOpcode() const { return Op; }
   Expr *getSubExpr() const { return SubExpr; }
+  void setSubExpr(Expr *E) { SubExpr = E; }
 
   static bool classof(const Expr *E) { return E->getKind() == EK_Unary; }
 };
 
-// Function call expression
-class CallExpr : public Expr {
-  StringRef Callee;
-  ExprList Args;
+// Function call expression. The arguments are stored inline after the node.
+class CallExpr final : public Expr,
+                       private llvm::TrailingObjects<CallExpr, Expr *> {
+  friend TrailingObjects;
+
+  IdentifierInfo *Callee;
+  unsigned NumArgs;
+
+  CallExpr(SMLoc Loc, IdentifierInfo *Callee, ArrayRef<Expr *> Args)
+      : Expr(EK_Call, Loc), Callee(Callee), NumArgs(Args.size()) {
+    std::uninitialized_copy(Args.begin(), Args.end(),
+                            getTrailingObjects<Expr *>());
+  }
 
 public:
-  CallExpr(SMLoc Loc, StringRef Callee, ExprList Args)
-      : Expr(EK_Call, Loc), Callee(Callee), Args(Args) {}
+  static CallExpr *Create(ASTContext &C, SMLoc Loc, IdentifierInfo *Callee,
+                          ArrayRef<Expr *> Args) {
+    void *Mem = C.Allocate(totalSizeToAlloc<Expr *>(Args.size()),
+                           alignof(CallExpr));
+    return new (Mem) CallExpr(Loc, Callee, Args);
+  }
 
-  StringRef getCallee() const { return Callee; }
-  const ExprList &getArgs() const { return Args; }
+  IdentifierInfo *getCalleeIdentifier() const { return Callee; }
+  StringRef getCallee() const { return Callee->getName(); }
+  ArrayRef<Expr *> getArgs() const {
+    return {getTrailingObjects<Expr *>(), NumArgs};
+  }
+  void setArg(unsigned I, Expr *E) {
+    assert(I < NumArgs && "argument index out of range");
+    getTrailingObjects<Expr *>()[I] = E;
+  }
 
   static bool classof(const Expr *E) { return E->getKind() == EK_Call; }
 };
 
 // Base class for all statements
-class Stmt {
+class Stmt : public ASTNode {
 public:
   enum StmtKind { SK_Expr, SK_Return, SK_If, SK_Compound };
 
@@ -220,8 +341,6 @@ protected:
   Stmt(StmtKind Kind) : Kind(Kind) {}
 
 public:
-  virtual ~Stmt() = default;
-
   StmtKind getKind() const { return Kind; }
 };
 
@@ -233,6 +352,7 @@ public:
   ExprStmt(Expr *E) : Stmt(SK_Expr), E(E) {}
 
   Expr *getExpr() const { return E; }
+  void setExpr(Expr *NewE) { E = NewE; }
 
   static bool classof(const Stmt *S) { return S->getKind() == SK_Expr; }
 };
@@ -245,6 +365,7 @@ public:
   ReturnStmt(Expr *RetVal = nullptr) : Stmt(SK_Return), RetVal(RetVal) {}
 
   Expr *getRetVal() const { return RetVal; }
+  void setRetVal(Expr *E) { RetVal = E; }
 
   static bool classof(const Stmt *S) { return S->getKind() == SK_Return; }
 };
@@ -260,20 +381,37 @@ public:
       : Stmt(SK_If), Cond(Cond), Then(Then), Else(Else) {}
 
   Expr *getCond() const { return Cond; }
+  void setCond(Expr *E) { Cond = E; }
   Stmt *getThen() const { return Then; }
   Stmt *getElse() const { return Else; }
 
   static bool classof(const Stmt *S) { return S->getKind() == SK_If; }
 };
 
-// Compound statement (block)
-class CompoundStmt : public Stmt {
-  StmtList Body;
+// Compound statement (block). The statements are stored inline after the
+// node.
+class CompoundStmt final : public Stmt,
+                           private llvm::TrailingObjects<CompoundStmt, Stmt *> {
+  friend TrailingObjects;
+
+  unsigned NumStmts;
+
+  CompoundStmt(ArrayRef<Stmt *> Body)
+      : Stmt(SK_Compound), NumStmts(Body.size()) {
+    std::uninitialized_copy(Body.begin(), Body.end(),
+                            getTrailingObjects<Stmt *>());
+  }
 
 public:
-  CompoundStmt(StmtList Body) : Stmt(SK_Compound), Body(Body) {}
+  static CompoundStmt *Create(ASTContext &C, ArrayRef<Stmt *> Body) {
+    void *Mem = C.Allocate(totalSizeToAlloc<Stmt *>(Body.size()),
+                           alignof(CompoundStmt));
+    return new (Mem) CompoundStmt(Body);
+  }
 
-  const StmtList &getBody() const { return Body; }
+  ArrayRef<Stmt *> getBody() const {
+    return {getTrailingObjects<Stmt *>(), NumStmts};
+  }
 
   static bool classof(const Stmt *S) { return S->getKind() == SK_Compound; }
 };
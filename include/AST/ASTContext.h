@@ -0,0 +1,88 @@
+#ifndef TINYCC_AST_ASTCONTEXT_H
+#define TINYCC_AST_ASTCONTEXT_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/Support/Allocator.h"
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace tinycc {
+
+/// Owns the memory of an AST. Nodes and their child arrays are bump allocated
+/// here and released together when the context is destroyed; nothing in the
+/// AST is freed on its own, and node destructors are never run.
+class ASTContext {
+  llvm::BumpPtrAllocator Allocator;
+  std::vector<std::unique_ptr<ASTContext>> SubContexts;
+
+public:
+  ASTContext() = default;
+  ASTContext(const ASTContext &) = delete;
+  ASTContext &operator=(const ASTContext &) = delete;
+
+  void *Allocate(size_t Size, size_t Align = alignof(std::max_align_t)) {
+    return Allocator.Allocate(Size, llvm::Align(Align));
+  }
+
+  /// Copies \p Elts into this context, e.g. a child array collected in a
+  /// temporary buffer.
+  template <typename T> llvm::ArrayRef<T> copyArray(llvm::ArrayRef<T> Elts) {
+    if (Elts.empty())
+      return {};
+    T *Mem = static_cast<T *>(Allocate(Elts.size() * sizeof(T), alignof(T)));
+    std::uninitialized_copy(Elts.begin(), Elts.end(), Mem);
+    return {Mem, Elts.size()};
+  }
+
+  /// Returns a new context whose memory lives as long as this one. Nodes
+  /// allocated in it may be linked into this context's AST. A BumpPtrAllocator
+  /// isn't thread-safe, so threads building parts of one AST in parallel each
+  /// allocate in their own sub-context. Creating sub-contexts is not itself
+  /// thread-safe; do it before starting the workers.
+  ASTContext &createSubContext() {
+    SubContexts.push_back(std::make_unique<ASTContext>());
+    return *SubContexts.back();
+  }
+
+  /// Bytes handed out to the AST so far, including sub-contexts.
+  size_t getBytesAllocated() const {
+    size_t Bytes = Allocator.getBytesAllocated();
+    for (const auto &Sub : SubContexts)
+      Bytes += Sub->getBytesAllocated();
+    return Bytes;
+  }
+
+  /// Bytes reserved from the system, including unused slab space.
+  size_t getTotalMemory() const {
+    size_t Bytes = Allocator.getTotalMemory();
+    for (const auto &Sub : SubContexts)
+      Bytes += Sub->getTotalMemory();
+    return Bytes;
+  }
+};
+
+/// Base of the Decl, Stmt and Expr hierarchies. Nodes can only be created in an
+/// ASTContext, with `new (Ctx) Node(...)`, and can't be deleted.
+class ASTNode {
+public:
+  // Every node member is at most pointer aligned.
+  void *operator new(size_t Bytes, ASTContext &C,
+                     size_t Align = alignof(void *)) {
+    return C.Allocate(Bytes, Align);
+  }
+
+  // Only called if a constructor throws; the memory goes with the context.
+  void operator delete(void *, ASTContext &, size_t) noexcept {}
+
+  // For nodes with trailing objects, whose Create() sizes the allocation.
+  void *operator new(size_t, void *Mem) noexcept { return Mem; }
+  void operator delete(void *, void *) noexcept {}
+
+  void *operator new(size_t) = delete;
+  void operator delete(void *) = delete;
+};
+
+} // namespace tinycc
+
+#endif // TINYCC_AST_ASTCONTEXT_H
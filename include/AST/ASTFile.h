@@ -0,0 +1,37 @@
+#ifndef TINYCC_AST_ASTFILE_H
+#define TINYCC_AST_ASTFILE_H
+
+#include "AST/FlatAST.h"
+#include "Support/IdentifierTable.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace tinycc {
+
+/// A serialized FlatAST, for reusing the AST of an unchanged input without
+/// lexing or parsing it again. The file holds the node records, child lists
+/// and side tables as fixed-size little-endian arrays, each 8-byte aligned,
+/// after a header giving their lengths. Nothing in it is a pointer: nodes
+/// refer to each other by index and to strings by offset into a string table.
+///
+/// Source locations are not stored, so nodes read back from a file have none.
+namespace astfile {
+
+/// Bumped whenever the layout changes. Files of another version are rejected.
+constexpr uint32_t Version = 1;
+
+/// Writes \p AST to \p OS.
+void write(const FlatAST &AST, llvm::raw_ostream &OS);
+
+/// Reads an AST written by write(), interning its names in \p Idents. Type
+/// names in the result point into \p Buffer, which must outlive it. Files that
+/// are truncated, of another version, or whose indices are out of range are
+/// rejected.
+llvm::Expected<FlatAST> read(llvm::MemoryBufferRef Buffer,
+                             IdentifierTable &Idents);
+
+} // namespace astfile
+} // namespace tinycc
+
+#endif // TINYCC_AST_ASTFILE_H
@@ -0,0 +1,193 @@
+#ifndef TINYCC_AST_FLATAST_H
+#define TINYCC_AST_FLATAST_H
+
+#include "AST/AST.h"
+#include "llvm/ADT/APFloat.h"
+#include "llvm/ADT/APSInt.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/Support/SMLoc.h"
+#include <cstdint>
+#include <vector>
+
+namespace tinycc {
+
+/// A compact encoding of an AST for cache-friendly traversal. Nodes are 16-byte
+/// records in one array, in pre-order: a node comes before its children, and a
+/// subtree occupies a contiguous range. Children are referenced by 32-bit node
+/// indices; names, types and literal values live in side tables, and variable
+/// length child lists in a shared index array.
+///
+/// The operands of each kind are:
+///
+///   Function        Type: return type, A: name, C: parameter count,
+///                   B: list of the C parameters followed by the body
+///   Param           Type, A: name
+///   Var             Type, A: name, B: initializer or NoNode
+///   ExprStmt        A: expression
+///   ReturnStmt      A: value or NoNode
+///   IfStmt          A: condition, B: then, C: else or NoNode
+///   CompoundStmt    B: list of C statements
+///   IntegerLiteral  A: index into the integer table
+///   FloatLiteral    A: index into the float table
+///   VarRef          A: name
+///   Binary          Op: BinaryExpr::BinaryOpKind, A: LHS, B: RHS
+///   Unary           Op: UnaryExpr::UnaryOpKind, A: operand
+///   Call            A: callee name, B: list of C arguments
+///
+/// A function without a body has an empty CompoundStmt.
+class FlatAST {
+public:
+  enum NodeKind : uint8_t {
+#define FLAT_NODE(Name) NK_##Name,
+#include "AST/FlatNodes.def"
+  };
+
+  static constexpr unsigned NumNodeKinds = 0
+#define FLAT_NODE(Name) +1
+#include "AST/FlatNodes.def"
+      ;
+
+  static constexpr uint32_t NoNode = ~0u;
+
+  struct Node {
+    NodeKind Kind;
+    uint8_t Op;
+    uint16_t Type;
+    uint32_t A;
+    uint32_t B;
+    uint32_t C;
+  };
+  static_assert(sizeof(Node) == 16, "FlatAST nodes should stay compact");
+
+private:
+  friend class FlatASTBuilder;
+  friend class ASTFileReader;
+  friend class ASTFileWriter;
+
+  std::vector<Node> Nodes;
+  // Source locations, parallel to Nodes, or empty if the AST was read from a
+  // file. Kept apart since traversals that don't report diagnostics never touch
+  // them.
+  std::vector<SMLoc> Locs;
+  std::vector<uint32_t> Lists;
+  std::vector<uint32_t> TopLevel;
+
+  std::vector<IdentifierInfo *> Names;
+  std::vector<StringRef> Types;
+  std::vector<llvm::APSInt> Ints;
+  std::vector<llvm::APFloat> Floats;
+
+public:
+  /// Converts the pointer-based AST rooted at \p Decls. Lazy function bodies
+  /// are parsed on the way.
+  static FlatAST build(ArrayRef<Decl *> Decls);
+
+  /// Converts back to the pointer-based AST, allocating the nodes in \p C.
+  /// Type names in the result point into the same storage as this AST's.
+  DeclList toDecls(ASTContext &C) const;
+
+  size_t size() const { return Nodes.size(); }
+  const Node &getNode(uint32_t I) const { return Nodes[I]; }
+  ArrayRef<Node> nodes() const { return Nodes; }
+  SMLoc getLocation(uint32_t I) const {
+    return Locs.empty() ? SMLoc() : Locs[I];
+  }
+
+  /// Indices of the top-level declarations, in source order.
+  ArrayRef<uint32_t> getTopLevelDecls() const { return TopLevel; }
+
+  IdentifierInfo *getName(const Node &N) const { return Names[N.A]; }
+  StringRef getType(const Node &N) const { return Types[N.Type]; }
+  const llvm::APSInt &getIntValue(const Node &N) const { return Ints[N.A]; }
+  const llvm::APFloat &getFloatValue(const Node &N) const {
+    return Floats[N.A];
+  }
+
+  /// The statements of a CompoundStmt or the arguments of a Call.
+  ArrayRef<uint32_t> getChildList(const Node &N) const {
+    return ArrayRef<uint32_t>(Lists).slice(N.B, N.C);
+  }
+  ArrayRef<uint32_t> getParams(const Node &Fn) const {
+    return ArrayRef<uint32_t>(Lists).slice(Fn.B, Fn.C);
+  }
+  uint32_t getBody(const Node &Fn) const { return Lists[Fn.B + Fn.C]; }
+
+  /// Bytes held by the encoding, side tables included.
+  size_t getMemorySize() const;
+};
+
+/// Walks a FlatAST in pre-order. Derived classes override visit<Kind>(I) for
+/// the node kinds they care about, returning false to skip the children of
+/// node I. Dispatch is static, so the walk compiles to a switch and direct
+/// calls.
+template <typename Derived> class FlatASTVisitor {
+  Derived &getDerived() { return *static_cast<Derived *>(this); }
+
+  void traverseList(ArrayRef<uint32_t> List) {
+    for (uint32_t I : List)
+      traverse(I);
+  }
+
+protected:
+  const FlatAST &AST;
+
+public:
+  explicit FlatASTVisitor(const FlatAST &AST) : AST(AST) {}
+
+  void traverseAST() { traverseList(AST.getTopLevelDecls()); }
+
+  void traverse(uint32_t I) {
+    if (I == FlatAST::NoNode)
+      return;
+    const FlatAST::Node &N = AST.getNode(I);
+    switch (N.Kind) {
+#define FLAT_NODE(Name)                                                        \
+  case FlatAST::NK_##Name:                                                     \
+    if (!getDerived().visit##Name(I))                                          \
+      return;                                                                  \
+    break;
+#include "AST/FlatNodes.def"
+    }
+
+    switch (N.Kind) {
+    case FlatAST::NK_Function:
+      traverseList(AST.getParams(N));
+      traverse(AST.getBody(N));
+      break;
+    case FlatAST::NK_Var:
+      traverse(N.B);
+      break;
+    case FlatAST::NK_ExprStmt:
+    case FlatAST::NK_ReturnStmt:
+    case FlatAST::NK_Unary:
+      traverse(N.A);
+      break;
+    case FlatAST::NK_IfStmt:
+      traverse(N.A);
+      traverse(N.B);
+      traverse(N.C);
+      break;
+    case FlatAST::NK_Binary:
+      traverse(N.A);
+      traverse(N.B);
+      break;
+    case FlatAST::NK_CompoundStmt:
+    case FlatAST::NK_Call:
+      traverseList(AST.getChildList(N));
+      break;
+    case FlatAST::NK_Param:
+    case FlatAST::NK_IntegerLiteral:
+    case FlatAST::NK_FloatLiteral:
+    case FlatAST::NK_VarRef:
+      break;
+    }
+  }
+
+#define FLAT_NODE(Name)                                                        \
+  bool visit##Name(uint32_t) { return true; }
+#include "AST/FlatNodes.def"
+};
+
+} // namespace tinycc
+
+#endif // TINYCC_AST_FLATAST_H
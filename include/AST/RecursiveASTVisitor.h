@@ -0,0 +1,166 @@
+#ifndef TINYCC_AST_RECURSIVEASTVISITOR_H
+#define TINYCC_AST_RECURSIVEASTVISITOR_H
+
+#include "AST/AST.h"
+#include "llvm/Support/Casting.h"
+#include "llvm/Support/ErrorHandling.h"
+
+namespace tinycc {
+
+/// Walks a whole AST in pre-order, calling Derived::visit<Class>() on every
+/// node. The walk over each class is done by traverse<Class>(), which calls
+/// visitDecl(), visitStmt() or visitExpr(), then visit<Class>(), then
+/// traverses the children. Any of them can be overridden:
+///
+///   - visit<Class>() to act on the nodes of one class, returning false to
+///     stop the whole traversal;
+///   - traverse<Class>() to change how a class is walked, e.g. to skip its
+///     children.
+///
+/// Dispatch is static, so a pass that overrides a few hooks compiles to a
+/// single walk with the rest of the traversal inlined. Walking a function
+/// parses its body if it was skipped by a lazy-body parse.
+template <typename Derived> class RecursiveASTVisitor {
+public:
+  Derived &getDerived() { return *static_cast<Derived *>(this); }
+
+  bool traverseAST(ArrayRef<Decl *> Decls) {
+    for (Decl *D : Decls)
+      if (!getDerived().traverseDecl(D))
+        return false;
+    return true;
+  }
+
+  bool traverseDecl(Decl *D) {
+    if (auto *FD = dyn_cast<FunctionDecl>(D))
+      return getDerived().traverseFunctionDecl(FD);
+    return getDerived().traverseVarDecl(cast<VarDecl>(D));
+  }
+
+  bool traverseStmt(Stmt *S) {
+    if (!S)
+      return true;
+    switch (S->getKind()) {
+#define STMT(Class, Kind)                                                      \
+  case Stmt::Kind:                                                             \
+    return getDerived().traverse##Class(static_cast<Class *>(S));
+#include "AST/StmtNodes.def"
+    }
+    llvm_unreachable("unknown statement kind");
+  }
+
+  bool traverseExpr(Expr *E) {
+    if (!E)
+      return true;
+    switch (E->getKind()) {
+#define EXPR(Class, Kind)                                                      \
+  case Expr::Kind:                                                             \
+    return getDerived().traverse##Class(static_cast<Class *>(E));
+#include "AST/StmtNodes.def"
+    }
+    llvm_unreachable("unknown expression kind");
+  }
+
+  // Declarations
+
+  bool traverseFunctionDecl(FunctionDecl *FD) {
+    if (!getDerived().visitDecl(FD) || !getDerived().visitFunctionDecl(FD))
+      return false;
+    for (ParamDecl *P : FD->getParams())
+      if (!getDerived().traverseParamDecl(P))
+        return false;
+    for (Stmt *S : FD->getBody())
+      if (!getDerived().traverseStmt(S))
+        return false;
+    return true;
+  }
+
+  bool traverseParamDecl(ParamDecl *PD) {
+    return getDerived().visitDecl(PD) && getDerived().visitParamDecl(PD);
+  }
+
+  bool traverseVarDecl(VarDecl *VD) {
+    return getDerived().visitDecl(VD) && getDerived().visitVarDecl(VD) &&
+           getDerived().traverseExpr(VD->getInit());
+  }
+
+  // Statements
+
+  bool traverseExprStmt(ExprStmt *S) {
+    return getDerived().visitStmt(S) && getDerived().visitExprStmt(S) &&
+           getDerived().traverseExpr(S->getExpr());
+  }
+
+  bool traverseReturnStmt(ReturnStmt *S) {
+    return getDerived().visitStmt(S) && getDerived().visitReturnStmt(S) &&
+           getDerived().traverseExpr(S->getRetVal());
+  }
+
+  bool traverseIfStmt(IfStmt *S) {
+    return getDerived().visitStmt(S) && getDerived().visitIfStmt(S) &&
+           getDerived().traverseExpr(S->getCond()) &&
+           getDerived().traverseStmt(S->getThen()) &&
+           getDerived().traverseStmt(S->getElse());
+  }
+
+  bool traverseCompoundStmt(CompoundStmt *S) {
+    if (!getDerived().visitStmt(S) || !getDerived().visitCompoundStmt(S))
+      return false;
+    for (Stmt *Sub : S->getBody())
+      if (!getDerived().traverseStmt(Sub))
+        return false;
+    return true;
+  }
+
+  // Expressions
+
+  bool traverseIntegerLiteral(IntegerLiteral *E) {
+    return getDerived().visitExpr(E) && getDerived().visitIntegerLiteral(E);
+  }
+
+  bool traverseFloatLiteral(FloatLiteral *E) {
+    return getDerived().visitExpr(E) && getDerived().visitFloatLiteral(E);
+  }
+
+  bool traverseVarRefExpr(VarRefExpr *E) {
+    return getDerived().visitExpr(E) && getDerived().visitVarRefExpr(E);
+  }
+
+  bool traverseBinaryExpr(BinaryExpr *E) {
+    return getDerived().visitExpr(E) && getDerived().visitBinaryExpr(E) &&
+           getDerived().traverseExpr(E->getLeft()) &&
+           getDerived().traverseExpr(E->getRight());
+  }
+
+  bool traverseUnaryExpr(UnaryExpr *E) {
+    return getDerived().visitExpr(E) && getDerived().visitUnaryExpr(E) &&
+           getDerived().traverseExpr(E->getSubExpr());
+  }
+
+  bool traverseCallExpr(CallExpr *E) {
+    if (!getDerived().visitExpr(E) || !getDerived().visitCallExpr(E))
+      return false;
+    for (Expr *Arg : E->getArgs())
+      if (!getDerived().traverseExpr(Arg))
+        return false;
+    return true;
+  }
+
+  // Visit hooks, all doing nothing by default.
+
+  bool visitDecl(Decl *) { return true; }
+  bool visitFunctionDecl(FunctionDecl *) { return true; }
+  bool visitParamDecl(ParamDecl *) { return true; }
+  bool visitVarDecl(VarDecl *) { return true; }
+
+  bool visitStmt(Stmt *) { return true; }
+  bool visitExpr(Expr *) { return true; }
+#define STMT(Class, Kind)                                                      \
+  bool visit##Class(Class *) { return true; }
+#define EXPR(Class, Kind) STMT(Class, Kind)
+#include "AST/StmtNodes.def"
+};
+
+} // namespace tinycc
+
+#endif // TINYCC_AST_RECURSIVEASTVISITOR_H
@@ -0,0 +1,59 @@
+#ifndef TINYCC_AST_STMTVISITOR_H
+#define TINYCC_AST_STMTVISITOR_H
+
+#include "AST/AST.h"
+#include "llvm/Support/ErrorHandling.h"
+
+namespace tinycc {
+
+/// Dispatches on the kind of a statement to Derived::visit<Class>(), e.g.
+/// visitIfStmt(IfStmt *). Derived classes override the classes they handle;
+/// the rest fall back to visitStmt(), which returns RetTy(). Dispatch is a
+/// switch and a direct call, with no virtual functions involved.
+template <typename Derived, typename RetTy = void> class StmtVisitor {
+  Derived &getDerived() { return *static_cast<Derived *>(this); }
+
+public:
+  RetTy visit(Stmt *S) {
+    switch (S->getKind()) {
+#define STMT(Class, Kind)                                                      \
+  case Stmt::Kind:                                                             \
+    return getDerived().visit##Class(static_cast<Class *>(S));
+#include "AST/StmtNodes.def"
+    }
+    llvm_unreachable("unknown statement kind");
+  }
+
+  RetTy visitStmt(Stmt *) { return RetTy(); }
+
+#define STMT(Class, Kind)                                                      \
+  RetTy visit##Class(Class *S) { return getDerived().visitStmt(S); }
+#include "AST/StmtNodes.def"
+};
+
+/// The same as StmtVisitor, for expressions. Unhandled classes fall back to
+/// visitExpr().
+template <typename Derived, typename RetTy = void> class ExprVisitor {
+  Derived &getDerived() { return *static_cast<Derived *>(this); }
+
+public:
+  RetTy visit(Expr *E) {
+    switch (E->getKind()) {
+#define EXPR(Class, Kind)                                                      \
+  case Expr::Kind:                                                             \
+    return getDerived().visit##Class(static_cast<Class *>(E));
+#include "AST/StmtNodes.def"
+    }
+    llvm_unreachable("unknown expression kind");
+  }
+
+  RetTy visitExpr(Expr *) { return RetTy(); }
+
+#define EXPR(Class, Kind)                                                      \
+  RetTy visit##Class(Class *E) { return getDerived().visitExpr(E); }
+#include "AST/StmtNodes.def"
+};
+
+} // namespace tinycc
+
+#endif // TINYCC_AST_STMTVISITOR_H
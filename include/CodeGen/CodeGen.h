@@ -2,63 +2,131 @@
 #define TINYCC_CODEGEN_CODEGEN_H
 
 #include "AST/AST.h"
+#include "AST/StmtVisitor.h"
 #include "Support/Diagnostic.h"
+#include <llvm/ADT/DenseMap.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Value.h>
-#include <map>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
 #include <memory>
 #include <string>
 
 namespace tinycc {
 
-class CodeGenerator {
-private:
-  DiagnosticsEngine &Diags;
+// The kinds of output file code generation can write
+enum class EmitKind { LLVMIR, Bitcode, Assembly, Object };
+
+// Create a TargetMachine for the given target triple, or for the host if it
+// is empty. Returns null and sets Error if no target supports the triple.
+std::unique_ptr<llvm::TargetMachine>
+createTargetMachine(StringRef Triple, unsigned OptLevel, std::string &Error);
+
+class CodeGenerator : public StmtVisitor<CodeGenerator>,
+                      public ExprVisitor<CodeGenerator, llvm::Value *> {
+  friend class StmtVisitor<CodeGenerator>;
+  friend class ExprVisitor<CodeGenerator, llvm::Value *>;
+
+  // Swapped for a deferring engine while generateCodeInParallel() generates
+  // a shard into this generator.
+  DiagnosticsEngine *Diags;
   std::unique_ptr<llvm::LLVMContext> Context;
   std::unique_ptr<llvm::Module> TheModule;
   std::unique_ptr<llvm::IRBuilder<>> Builder;
 
-  // Symbol table for variables
-  std::map<std::string, llvm::Value *> NamedValues;
+  // Symbol table for variables, keyed by interned identifier
+  llvm::DenseMap<const IdentifierInfo *, llvm::Value *> NamedValues;
+
+  // Functions generated so far, keyed by interned identifier
+  llvm::DenseMap<const IdentifierInfo *, llvm::Function *> Functions;
 
   // Current function being generated
   llvm::Function *CurFunction;
 
-  // Helper methods for code generation
-  llvm::Value *generateExpr(Expr *E);
-  llvm::Value *generateIntegerLiteral(IntegerLiteral *IL);
-  llvm::Value *generateFloatLiteral(FloatLiteral *FL);
-  llvm::Value *generateVarRefExpr(VarRefExpr *VR);
-  llvm::Value *generateBinaryExpr(BinaryExpr *BE);
-  llvm::Value *generateUnaryExpr(UnaryExpr *UE);
-  llvm::Value *generateCallExpr(CallExpr *CE);
+  // Placeholder in the entry block of CurFunction that allocas are inserted
+  // before
+  llvm::Instruction *AllocaInsertPt = nullptr;
+
+  // The target code is generated for, if any
+  llvm::TargetMachine *TM = nullptr;
+
+  // Code generation for expressions and statements, reached through visit()
+  using ExprVisitor::visit;
+  llvm::Value *visitIntegerLiteral(IntegerLiteral *IL);
+  llvm::Value *visitFloatLiteral(FloatLiteral *FL);
+  llvm::Value *visitVarRefExpr(VarRefExpr *VR);
+  llvm::Value *visitBinaryExpr(BinaryExpr *BE);
+  llvm::Value *visitUnaryExpr(UnaryExpr *UE);
+  llvm::Value *visitCallExpr(CallExpr *CE);
 
-  void generateStmt(Stmt *S);
-  void generateReturnStmt(ReturnStmt *RS);
-  void generateIfStmt(IfStmt *IS);
-  void generateCompoundStmt(CompoundStmt *CS);
-  void generateExprStmt(ExprStmt *ES);
+  using StmtVisitor::visit;
+  void visitReturnStmt(ReturnStmt *RS);
+  void visitIfStmt(IfStmt *IS);
+  void visitCompoundStmt(CompoundStmt *CS);
+  void visitExprStmt(ExprStmt *ES);
 
-  llvm::Function *generateFunctionDecl(FunctionDecl *FD);
-  llvm::Value *generateVarDecl(VarDecl *VD);
+  // Generate Decls[Begin, End) and only declare the rest, which another
+  // generator defines. All of Decls are visited in order either way, so that
+  // names resolve and are uniqued the same in every generator.
+  bool generateDecls(ArrayRef<Decl *> Decls, size_t Begin, size_t End);
+  llvm::Function *generateFunctionDecl(FunctionDecl *FD, bool Define = true);
+  llvm::Value *generateVarDecl(VarDecl *VD, bool Define = true);
+
+  // Create a stack slot for a local of CurFunction in its entry block
+  llvm::AllocaInst *createEntryBlockAlloca(llvm::Type *Ty,
+                                           const llvm::Twine &Name);
 
   // Type conversion helpers
   llvm::Type *getLLVMType(StringRef TypeName);
   llvm::FunctionType *getFunctionType(FunctionDecl *FD);
+  llvm::Value *convertToType(llvm::Value *V, llvm::Type *Ty);
 
 public:
   CodeGenerator(DiagnosticsEngine &Diags, StringRef ModuleName = "tinycc_module");
 
   // Main entry point for code generation
-  bool generateCode(const std::vector<std::unique_ptr<Decl>> &Decls);
+  bool generateCode(ArrayRef<Decl *> Decls);
+
+  // Generate code for Decls on worker threads and run the -O<OptLevel>
+  // pipeline. The declarations are split into NumShards runs of about equal
+  // size, each generated and optimized in a module and LLVMContext of its own
+  // that declares what the other runs define. The shards are then linked
+  // into this generator's module, in order. Optimization doesn't cross
+  // shards, so e.g. a call into another shard isn't inlined.
+  bool generateCodeInParallel(ArrayRef<Decl *> Decls, unsigned NumShards,
+                              unsigned OptLevel);
+
+  // Generate code for the target of TM, which must outlive the generator.
+  // Sets the module's triple and data layout, so call it before
+  // generateCode(). Without a target the module is target independent, which
+  // is enough for IR and bitcode output.
+  void setTargetMachine(llvm::TargetMachine *TM);
+
+  // Run the default LLVM pipeline for -O<OptLevel> (0 to 3) over the module.
+  // With LLVM's -time-passes option, a report of the time spent in each pass
+  // is printed when the pipeline finishes.
+  void optimize(unsigned OptLevel);
 
   // Get the generated LLVM module
   llvm::Module *getModule() const { return TheModule.get(); }
 
   // Print the generated LLVM IR to the given output stream
   void print(llvm::raw_ostream &OS);
+
+  // JIT-compile the module for the host and run its main() with argv set to
+  // ProgramName followed by Args, returning main's result. The module is
+  // handed over to the JIT, so the generator can't be used afterwards. If
+  // CacheDir isn't empty, compiled objects are kept there and reused while the
+  // module is unchanged.
+  llvm::Expected<int> runMain(StringRef ProgramName, ArrayRef<std::string> Args,
+                              StringRef CacheDir);
+
+  // Write the module to OS as Kind. Assembly and object files need a target
+  // machine. Returns false if the target can't write that kind of file.
+  bool emit(llvm::raw_pwrite_stream &OS, EmitKind Kind);
 };
 
 } // namespace tinycc
@@ -0,0 +1,42 @@
+#ifndef TINYCC_LEXER_CHARINFO_H
+#define TINYCC_LEXER_CHARINFO_H
+
+#include "llvm/Support/Compiler.h"
+
+namespace tinycc {
+namespace charinfo {
+// All of the predicates below compare against ASCII ranges, so bytes >= 0x80
+// fall out naturally and no separate isASCII() check is needed.
+LLVM_READNONE inline bool isASCII(char Ch) {
+  return static_cast<unsigned char>(Ch) <= 127;
+}
+
+LLVM_READNONE inline bool isVerticalWhitespace(char Ch) {
+  return Ch == '\r' || Ch == '\n';
+}
+
+LLVM_READNONE inline bool isHorizontalWhitespace(char Ch) {
+  return Ch == ' ' || Ch == '\t' || Ch == '\f' || Ch == '\v';
+}
+
+LLVM_READNONE inline bool isWhitespace(char Ch) {
+  return isHorizontalWhitespace(Ch) || isVerticalWhitespace(Ch);
+}
+
+LLVM_READNONE inline bool isDigit(char Ch) { return Ch >= '0' && Ch <= '9'; }
+
+LLVM_READNONE inline bool isHexDigit(char Ch) {
+  return isDigit(Ch) || (Ch >= 'A' && Ch <= 'F');
+}
+
+LLVM_READNONE inline bool isIdentifierHead(char Ch) {
+  return Ch == '_' || (Ch >= 'A' && Ch <= 'Z') || (Ch >= 'a' && Ch <= 'z');
+}
+
+LLVM_READNONE inline bool isIdentifierBody(char Ch) {
+  return isIdentifierHead(Ch) || isDigit(Ch);
+}
+} // namespace charinfo
+} // namespace tinycc
+
+#endif // TINYCC_LEXER_CHARINFO_H
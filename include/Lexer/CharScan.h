@@ -0,0 +1,63 @@
+#ifndef TINYCC_LEXER_CHARSCAN_H
+#define TINYCC_LEXER_CHARSCAN_H
+
+#include "Lexer/CharInfo.h"
+
+namespace tinycc {
+namespace scan {
+
+/// The instruction set used by the scanning kernels. The best one supported by
+/// the host is picked the first time a kernel runs.
+enum class ISA { Scalar, SSE2, AVX2 };
+
+/// Returns the instruction set the kernels currently dispatch to.
+ISA getISA();
+
+/// Forces the kernels onto \p Kind, falling back to the best supported one if
+/// the host can't run it. Returns the instruction set actually selected. This
+/// is meant for benchmarks and differential testing.
+ISA setISA(ISA Kind);
+
+/// Returns a printable name like "avx2".
+const char *getISAName(ISA Kind);
+
+namespace detail {
+const char *skipWhitespace(const char *Ptr, const char *End);
+const char *skipIdentifierBody(const char *Ptr, const char *End);
+const char *findLineEnd(const char *Ptr, const char *End);
+const char *findBlockCommentEnd(const char *Ptr, const char *End);
+} // namespace detail
+
+// The wrappers below handle the common one-byte case inline and only call into
+// the vector kernels for longer runs. All of them return \p End if the input
+// runs out first.
+
+/// Returns the first non-whitespace character in [Ptr, End).
+inline const char *skipWhitespace(const char *Ptr, const char *End) {
+  if (Ptr == End || !charinfo::isWhitespace(*Ptr))
+    return Ptr;
+  return detail::skipWhitespace(Ptr + 1, End);
+}
+
+/// Returns the first character in [Ptr, End) that can't continue an
+/// identifier.
+inline const char *skipIdentifierBody(const char *Ptr, const char *End) {
+  if (Ptr == End || !charinfo::isIdentifierBody(*Ptr))
+    return Ptr;
+  return detail::skipIdentifierBody(Ptr + 1, End);
+}
+
+/// Returns the first '\n' in [Ptr, End).
+inline const char *findLineEnd(const char *Ptr, const char *End) {
+  return detail::findLineEnd(Ptr, End);
+}
+
+/// Returns a pointer to the '*' of the first "*/" in [Ptr, End).
+inline const char *findBlockCommentEnd(const char *Ptr, const char *End) {
+  return detail::findBlockCommentEnd(Ptr, End);
+}
+
+} // namespace scan
+} // namespace tinycc
+
+#endif // TINYCC_LEXER_CHARSCAN_H
@@ -2,28 +2,33 @@
 #define TINYLANG_LEXER_LEXER_H
 
 #include "Lexer/Token.h"
+#include "Lexer/TokenStream.h"
 #include "Support/Diagnostic.h"
+#include "Support/IdentifierTable.h"
+#include "Support/KeywordTable.h"
 #include "Support/TokenKinds.h"
-#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/MemoryBuffer.h"
 
 namespace tinycc {
 
 class KeywordFilter {
-  llvm::StringMap<tok::TokenKind> HashTable;
-
-  void addKeyword(StringRef Keyword, tok::TokenKind TokenCode);
-
 public:
-  void addKeywords();
-
+  /// The keyword table is a compile-time perfect hash over TokenKinds.def (see
+  /// Support/KeywordTable.h), so there is nothing to build at runtime.
   tok::TokenKind getKeyword(StringRef Name,
                             tok::TokenKind DefaultTokenCode = tok::unknown) {
-    auto Result = HashTable.find(Name);
-    if (Result != HashTable.end())
-      return Result->second;
-    return DefaultTokenCode;
+    return tok::getKeywordKind(Name, DefaultTokenCode);
+  }
+
+  /// Returns the keyword \p Name spells in the wrong case, or \p
+  /// DefaultTokenCode if it is not a miscased keyword.
+  tok::TokenKind getMiscasedKeyword(
+      StringRef Name, tok::TokenKind DefaultTokenCode = tok::unknown) {
+    tok::TokenKind Kind = tok::getKeywordKindIgnoreCase(Name, DefaultTokenCode);
+    if (Kind != DefaultTokenCode && Name == tok::getKeywordSpelling(Kind))
+      return DefaultTokenCode;
+    return Kind;
   }
 };
 
@@ -31,9 +36,16 @@ class Lexer {
   SourceMgr &SrcMgr;
   DiagnosticsEngine &Diags;
 
+  /// Interned identifier spellings, shared with the AST and code generator.
+  IdentifierTable &Idents;
+
   const char *CurPtr;
   StringRef CurBuf;
 
+  /// End of the range being lexed. This is CurBuf.end() except for the chunk
+  /// lexers used by lexAllParallel(), which stop at their chunk boundary.
+  const char *BufEnd;
+
   /// CurBuffer - This is the current buffer index we're
   /// lexing from as managed by the SourceMgr object.
   unsigned CurBuffer = 0;
@@ -45,20 +57,36 @@ class Lexer {
   bool HasLookahead = false;
 
 public:
-  Lexer(SourceMgr &SrcMgr, DiagnosticsEngine &Diags)
-      : SrcMgr(SrcMgr), Diags(Diags) {
-    CurBuffer = SrcMgr.getMainFileID();
+  /// Lexes the buffer \p BufferID of \p SrcMgr, or the main file if it is 0.
+  Lexer(SourceMgr &SrcMgr, DiagnosticsEngine &Diags, IdentifierTable &Idents,
+        unsigned BufferID = 0)
+      : SrcMgr(SrcMgr), Diags(Diags), Idents(Idents) {
+    CurBuffer = BufferID ? BufferID : SrcMgr.getMainFileID();
     CurBuf = SrcMgr.getMemoryBuffer(CurBuffer)->getBuffer();
     CurPtr = CurBuf.begin();
-    Keywords.addKeywords();
+    BufEnd = CurBuf.end();
+    checkBufferSize();
+  }
+
+  /// Lexes \p Buffer, which need not be one of \p SrcMgr's, e.g. a piece of
+  /// a larger text that is kept elsewhere.
+  Lexer(SourceMgr &SrcMgr, DiagnosticsEngine &Diags, IdentifierTable &Idents,
+        StringRef Buffer)
+      : SrcMgr(SrcMgr), Diags(Diags), Idents(Idents) {
+    CurBuf = Buffer;
+    CurPtr = CurBuf.begin();
+    BufEnd = CurBuf.end();
+    checkBufferSize();
   }
 
   // Constructor for testing - directly initialize from string
   Lexer(StringRef Input)
-      : SrcMgr(*(new SourceMgr())), Diags(*(new DiagnosticsEngine(SrcMgr))) {
+      : SrcMgr(*(new SourceMgr())), Diags(*(new DiagnosticsEngine(SrcMgr))),
+        Idents(*(new IdentifierTable())) {
     CurBuf = Input;
     CurPtr = CurBuf.begin();
-    Keywords.addKeywords();
+    BufEnd = CurBuf.end();
+    checkBufferSize();
   }
 
   DiagnosticsEngine &getDiagnostics() const { return Diags; }
@@ -72,6 +100,33 @@ public:
   /// Gets source code buffer.
   StringRef getBuffer() const { return CurBuf; }
 
+  /// Gets the source location of a token lexed from this buffer.
+  SMLoc getLocation(const Token &Tok) const { return Tok.getLocation(CurBuf); }
+
+  /// Gets the spelling of a token lexed from this buffer.
+  StringRef getSpelling(const Token &Tok) const {
+    return Tok.getIdentifier(CurBuf);
+  }
+
+  IdentifierTable &getIdentifierTable() const { return Idents; }
+
+  /// Interns the spelling of an identifier token. Tokens are kept at 8 bytes,
+  /// so they don't carry the IdentifierInfo; the parser calls this once per
+  /// identifier it consumes and the AST holds on to the result.
+  IdentifierInfo *getIdentifierInfo(const Token &Tok) const {
+    assert(Tok.is(tok::identifier) && "interning a non-identifier token");
+    return &Idents.get(getSpelling(Tok));
+  }
+
+  /// Lexes the rest of the input into \p Tokens in one pass, ending with the
+  /// eof token.
+  void lexAll(TokenStream &Tokens);
+
+  /// Like lexAll(), but splits the input into chunks of about \p ChunkSize
+  /// bytes at newlines outside comments and lexes them concurrently. The
+  /// result is token-for-token identical to lexAll().
+  void lexAllParallel(TokenStream &Tokens, size_t ChunkSize = 1 << 20);
+
   /// For testing - get all tokens from the input
   std::vector<Token> getAllTokens() {
     std::vector<Token> Tokens;
@@ -84,6 +139,14 @@ public:
   }
 
 private:
+  // Creates a lexer for the chunk [Begin, End) of Parent's buffer, reporting
+  // to Diags. Token offsets stay relative to the start of the whole buffer.
+  Lexer(const Lexer &Parent, DiagnosticsEngine &Diags, const char *Begin,
+        const char *End)
+      : SrcMgr(Parent.SrcMgr), Diags(Diags), Idents(Parent.Idents),
+        CurPtr(Begin), CurBuf(Parent.CurBuf), BufEnd(End),
+        CurBuffer(Parent.CurBuffer), Keywords(Parent.Keywords) {}
+
   void identifier(Token &Result);
   // Form a number token from the current position.
   void number(Token &Result);
@@ -92,6 +155,16 @@ private:
 
   void comment();
 
+  // Token offsets are 32 bits wide, so refuse buffers that don't fit.
+  void checkBufferSize();
+
+  // Returns the character at Ptr, or '\0' at the end of the buffer. The
+  // buffer itself is not assumed to be NUL-terminated, and an embedded NUL is
+  // lexed like any other character.
+  char peekChar(const char *Ptr) const {
+    return Ptr < BufEnd ? *Ptr : '\0';
+  }
+
   // Get the location of the current position.
   SMLoc getLoc(const char *Ptr = nullptr) {
     if (Ptr == nullptr)
@@ -109,7 +182,17 @@ class LexerDriver {
 public:
   LexerDriver(class Lexer &Lexer) : Lexer(Lexer) {}
 
-  void run() {
+  /// Lexes the whole input. If \p Tokens is given, the tokens are collected
+  /// into it rather than dropped as they are produced, and a non-zero
+  /// \p ChunkSize lexes chunks of that many bytes in parallel.
+  void run(TokenStream *Tokens = nullptr, size_t ChunkSize = 0) {
+    if (Tokens) {
+      if (ChunkSize)
+        Lexer.lexAllParallel(*Tokens, ChunkSize);
+      else
+        Lexer.lexAll(*Tokens);
+      return;
+    }
     Token Tok;
     do {
       Lexer.next(Tok);
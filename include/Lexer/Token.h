@@ -4,6 +4,7 @@
 #include "Support/TokenKinds.h"
 #include <llvm/ADT/StringRef.h>
 #include <llvm/Support/SMLoc.h>
+#include <cstdint>
 
 using namespace llvm;
 
@@ -11,20 +12,32 @@ namespace tinycc {
 
 class Lexer;
 
+/// A token is a kind plus a [Offset, Offset + Length) range in the buffer it
+/// was lexed from. It deliberately does not hold a pointer: that keeps it at 8
+/// bytes, so materialized token streams stay small and cache friendly. The
+/// accessors that need characters take the buffer (usually via
+/// Lexer::getLocation/getSpelling).
 class Token {
   friend class Lexer;
 
-  /// The location of the token.
-  const char *Ptr;
+  /// The offset of the token from the start of its buffer.
+  uint32_t Offset = 0;
 
   /// The length of the token.
-  size_t Length;
+  uint32_t Length : 24;
 
   /// Kind - The actual flavor of token this is.
-  tok::TokenKind Kind;
+  uint32_t Kind : 8;
 
 public:
-  tok::TokenKind getKind() const { return Kind; }
+  /// Tokens longer than this can't be represented.
+  static constexpr size_t MaxLength = (1u << 24) - 1;
+
+  Token() : Length(0), Kind(tok::unknown) {}
+  Token(tok::TokenKind Kind, uint32_t Offset, uint32_t Length)
+      : Offset(Offset), Length(Length), Kind(Kind) {}
+
+  tok::TokenKind getKind() const { return static_cast<tok::TokenKind>(Kind); }
   void setKind(tok::TokenKind K) { Kind = K; }
 
   /// is/isNot - Predicates to check if this token is a
@@ -36,28 +49,35 @@ public:
     return (... || is(Toks));
   }
 
-  const char *getName() const { return tok::getTokenName(Kind); }
+  const char *getName() const { return tok::getTokenName(getKind()); }
 
-  SMLoc getLocation() const { return SMLoc::getFromPointer(Ptr); }
+  uint32_t getOffset() const { return Offset; }
   size_t getLength() const { return Length; }
 
-  StringRef getIdentifier() const {
+  SMLoc getLocation(StringRef Buffer) const {
+    return SMLoc::getFromPointer(Buffer.data() + Offset);
+  }
+
+  StringRef getIdentifier(StringRef Buffer) const {
     // assert(is(tok::identifier) && "Cannot get identfier of non-identifier");
-    return StringRef(Ptr, Length);
+    return Buffer.substr(Offset, Length);
   }
 
-  StringRef getLiteralData() const {
+  StringRef getLiteralData(StringRef Buffer) const {
     assert(isOneOf(tok::identifier) &&
            "Cannot get literal data of non-literal");
-    return StringRef(Ptr, Length);
+    return Buffer.substr(Offset, Length);
   }
 
-  StringRef getConstantValue() const {
+  StringRef getConstantValue(StringRef Buffer) const {
     assert(isOneOf(tok::integer_cons, tok::float_cons) &&
            "Cannot get value of non-constant token");
-    return StringRef(Ptr, Length);
+    return Buffer.substr(Offset, Length);
   }
 };
 
+static_assert(sizeof(Token) == 8, "Token should pack into 8 bytes");
+static_assert(tok::NUM_TOKENS <= 256, "token kinds must fit in 8 bits");
+
 } // namespace tinycc
 #endif
@@ -0,0 +1,80 @@
+#ifndef TINYCC_LEXER_TOKENSTREAM_H
+#define TINYCC_LEXER_TOKENSTREAM_H
+
+#include "Lexer/Token.h"
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+namespace tinycc {
+
+/// A fully lexed buffer stored as a structure of arrays. Kinds, offsets and
+/// lengths live in separate arrays, so a scan that only looks at kinds (brace
+/// matching, lookahead) touches one byte per token. The stream always ends with
+/// an eof token.
+class TokenStream {
+  std::vector<uint8_t> Kinds;
+  std::vector<uint32_t> Offsets;
+  std::vector<uint32_t> Lengths;
+
+public:
+  void reserve(size_t N) {
+    Kinds.reserve(N);
+    Offsets.reserve(N);
+    Lengths.reserve(N);
+  }
+
+  void push_back(const Token &Tok) {
+    Kinds.push_back(static_cast<uint8_t>(Tok.getKind()));
+    Offsets.push_back(Tok.getOffset());
+    Lengths.push_back(static_cast<uint32_t>(Tok.getLength()));
+  }
+
+  /// Appends tokens [Begin, End) of \p Other, moving their offsets by
+  /// \p OffsetDelta (used when splicing streams of an edited buffer).
+  void append(const TokenStream &Other, size_t Begin, size_t End,
+              int64_t OffsetDelta = 0) {
+    assert(Begin <= End && End <= Other.size() && "bad token range");
+    Kinds.insert(Kinds.end(), Other.Kinds.begin() + Begin,
+                 Other.Kinds.begin() + End);
+    Lengths.insert(Lengths.end(), Other.Lengths.begin() + Begin,
+                   Other.Lengths.begin() + End);
+    size_t First = Offsets.size();
+    Offsets.insert(Offsets.end(), Other.Offsets.begin() + Begin,
+                   Other.Offsets.begin() + End);
+    if (OffsetDelta)
+      for (size_t I = First, E = Offsets.size(); I != E; ++I)
+        Offsets[I] = static_cast<uint32_t>(Offsets[I] + OffsetDelta);
+  }
+
+  void clear() {
+    Kinds.clear();
+    Offsets.clear();
+    Lengths.clear();
+  }
+
+  size_t size() const { return Kinds.size(); }
+  bool empty() const { return Kinds.empty(); }
+
+  tok::TokenKind getKind(size_t I) const {
+    return static_cast<tok::TokenKind>(Kinds[I]);
+  }
+  uint32_t getOffset(size_t I) const { return Offsets[I]; }
+  uint32_t getLength(size_t I) const { return Lengths[I]; }
+
+  /// Rebuilds the I-th token. Indices past the end clamp to the trailing eof,
+  /// so callers can look ahead any distance without bounds checks.
+  Token operator[](size_t I) const {
+    assert(!empty() && "empty token stream");
+    if (I >= size())
+      I = size() - 1;
+    return Token(getKind(I), Offsets[I], Lengths[I]);
+  }
+
+  const std::vector<uint8_t> &kinds() const { return Kinds; }
+  const std::vector<uint32_t> &offsets() const { return Offsets; }
+  const std::vector<uint32_t> &lengths() const { return Lengths; }
+};
+
+} // namespace tinycc
+#endif // TINYCC_LEXER_TOKENSTREAM_H
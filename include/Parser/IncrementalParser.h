@@ -0,0 +1,153 @@
+#ifndef TINYCC_PARSER_INCREMENTALPARSER_H
+#define TINYCC_PARSER_INCREMENTALPARSER_H
+
+#include "AST/AST.h"
+#include "AST/ASTContext.h"
+#include "Lexer/TokenStream.h"
+#include "Support/Diagnostic.h"
+#include "Support/IdentifierTable.h"
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace tinycc {
+
+/// Replaces RemovedLength bytes at Offset with Inserted.
+struct TextEdit {
+  uint32_t Offset = 0;
+  uint32_t RemovedLength = 0;
+  llvm::StringRef Inserted;
+};
+
+/// Keeps the tokens and top-level declarations of a buffer up to date across
+/// edits, re-lexing and re-parsing only the part an edit can affect.
+///
+/// The text is held as a sequence of segments: runs of whole top-level
+/// declarations of about SegmentSize bytes, each with its own tokens and
+/// declarations. Token offsets are relative to the segment's buffer, not to
+/// the whole text, so an edit only rebuilds the segments it touches. Their
+/// text, with the edit applied, is copied into a new buffer and lexed and
+/// parsed again. The segments around them are not touched, so the cost of an
+/// edit doesn't depend on the size of the text.
+///
+/// This relies on the lexer and parser having no state between top-level
+/// declarations. Segments end right after the ';' or '}' closing a
+/// declaration, or at a newline outside any comment, so a segment lexes and
+/// parses on its own just as it does as part of the whole text. An edit that
+/// breaks this, e.g. by opening a comment or deleting a closing brace, makes
+/// its segment take in the segments after it until the result parses, or has
+/// an error that no text after it could change.
+///
+/// An edit that leaves the text with an error is rejected: applyEdit()
+/// returns false, the segments are left as they were, and getLastError()
+/// holds the first error, as a full parse of the edited text would report
+/// it. An editor can go on applying edits from there.
+///
+/// Segment buffers are owned here and freed once no segment uses them. The
+/// nodes of replaced declarations stay in the ASTContext until it is
+/// destroyed. The buffers are not added to the SourceMgr, so the SMLocs held
+/// by the declarations point into the segment buffers.
+class IncrementalParser {
+public:
+  struct Stats {
+    size_t TokensRelexed = 0;
+    size_t DeclsReparsed = 0;
+    size_t DeclsReused = 0;
+  };
+
+  /// An error that made parse() or applyEdit() fail, at Offset in the text
+  /// that was given or would have resulted from the edit.
+  struct ParseError {
+    uint32_t Offset = 0;
+    SourceMgr::DiagKind Kind = SourceMgr::DK_Error;
+    std::string Msg;
+  };
+
+  /// Segments are split to about this many bytes unless the constructor is
+  /// given another size.
+  static constexpr size_t DefaultSegmentSize = 1024;
+
+private:
+  struct Segment {
+    std::shared_ptr<const llvm::MemoryBuffer> Buffer;
+    /// The segment's bytes in Buffer, which neighbouring segments may share.
+    /// Token offsets are relative to the start of Buffer.
+    uint32_t Begin = 0;
+    uint32_t End = 0;
+    TokenStream Tokens;
+    DeclList Decls;
+
+    llvm::StringRef getText() const {
+      return Buffer->getBuffer().slice(Begin, End);
+    }
+  };
+
+  SourceMgr &SrcMgr;
+  IdentifierTable &Idents;
+
+  std::string BufferName;
+  size_t SegmentSize;
+  ASTContext Ctx;
+
+  /// Held by pointer so that replacing some segments only moves pointers to
+  /// the ones after them.
+  std::vector<std::unique_ptr<Segment>> Segments;
+  /// The size of each segment in bytes, apart from the segments so that
+  /// finding the one at an offset scans a dense array.
+  std::vector<uint32_t> Sizes;
+  size_t NumDecls = 0;
+
+  Stats LastStats;
+  std::optional<ParseError> LastError;
+
+  enum class LexAndParseResult { Parsed, Error, NeedsMore };
+
+  /// Lexes and parses all of \p Buf, which starts at \p TextStart in the
+  /// whole text, appending it to \p Out as one or more segments. Returns
+  /// NeedsMore if the text can't end a segment, or has an error that more
+  /// text after it could change, and \p AtEnd is false. Otherwise an error
+  /// is left in LastError.
+  LexAndParseResult lexAndParse(std::shared_ptr<const llvm::MemoryBuffer> Buf,
+                                uint32_t TextStart, bool AtEnd,
+                                std::vector<std::unique_ptr<Segment>> &Out);
+
+public:
+  IncrementalParser(SourceMgr &SrcMgr, IdentifierTable &Idents,
+                    llvm::StringRef BufferName = "<incremental>",
+                    size_t SegmentSize = DefaultSegmentSize)
+      : SrcMgr(SrcMgr), Idents(Idents), BufferName(BufferName.str()),
+        SegmentSize(SegmentSize) {}
+
+  /// Lexes and parses \p Source from scratch. Returns false, keeping the
+  /// previous text if any, if it has an error.
+  bool parse(llvm::StringRef Source);
+
+  /// Applies \p Edit to the current text and brings the tokens and
+  /// declarations up to date. Returns false, keeping the text as it was, if
+  /// the edited text has an error.
+  bool applyEdit(const TextEdit &Edit);
+
+  /// The error the last parse() or applyEdit() failed with, if it did.
+  const std::optional<ParseError> &getLastError() const { return LastError; }
+
+  /// The whole text, its tokens with offsets into it, and its declarations.
+  /// These are put together from the segments on every call, in time linear
+  /// in the size of the text, e.g. to compare against a full parse.
+  std::string getText() const;
+  TokenStream getTokens() const;
+  DeclList getDecls() const;
+
+  size_t getNumDecls() const { return NumDecls; }
+  size_t getNumSegments() const { return Segments.size(); }
+  ASTContext &getASTContext() { return Ctx; }
+
+  /// Work done by the last parse() or applyEdit().
+  const Stats &getLastStats() const { return LastStats; }
+};
+
+} // namespace tinycc
+
+#endif // TINYCC_PARSER_INCREMENTALPARSER_H
@@ -2,72 +2,161 @@
 #define TINYCC_PARSER_PARSER_H
 
 #include "AST/AST.h"
+#include "AST/ASTContext.h"
 #include "Lexer/Lexer.h"
 #include "Support/Diagnostic.h"
+#include <llvm/ADT/SmallVector.h>
 #include <llvm/ADT/StringRef.h>
-#include <memory>
 
 namespace tinycc {
 
-class Parser {
+class Parser : public LazyBodySource {
 private:
   Lexer &Lex;
-  DiagnosticsEngine &Diags;
+  // Swapped for a deferring engine during the top-level pass of a
+  // parallel-body parse.
+  DiagnosticsEngine *Diags;
+
+  // Owns every node the parser creates.
+  ASTContext &Ctx;
+
   Token CurTok;
 
+  // Finds miscased keywords for checkKeywordCaseError().
+  KeywordFilter Keywords;
+
+  // Pre-lexed tokens, if the parser was created with a TokenStream. CurTok is
+  // then always Tokens[TokIdx].
+  const TokenStream *Tokens = nullptr;
+  size_t TokIdx = 0;
+
+  // Whether function bodies are skipped and parsed on demand.
+  bool LazyBodies = false;
+
+  // Whether parse() parses function bodies on worker threads.
+  bool ParallelBodies = false;
+
   // Utility methods for token handling
-  void advance() { Lex.next(CurTok); }
+  void advance() {
+    if (Tokens)
+      CurTok = (*Tokens)[++TokIdx];
+    else
+      Lex.next(CurTok);
+  }
+
+  // Returns the token N positions after CurTok. This is O(1) for any N when
+  // parsing from a TokenStream; otherwise only N == 1 is available.
+  Token peek(unsigned N = 1) {
+    if (Tokens)
+      return (*Tokens)[TokIdx + N];
+    assert(N == 1 && "only one token of lookahead without a TokenStream");
+    return Lex.lookAhead();
+  }
   bool consume(tok::TokenKind Kind);
   bool expect(tok::TokenKind Kind);
 
   // Parsing methods for declarations
-  std::unique_ptr<FunctionDecl> parseFunctionDecl();
-  std::unique_ptr<VarDecl> parseVarDecl();
-  std::unique_ptr<ParamDecl> parseParamDecl();
-  ParamList parseParamList();
+  FunctionDecl *parseFunctionDecl();
+  VarDecl *parseVarDecl();
+  ParamDecl *parseParamDecl();
+  void parseParamList(SmallVectorImpl<ParamDecl *> &Params);
 
   // Parsing methods for statements
-  std::unique_ptr<Stmt> parseStmt();
-  std::unique_ptr<CompoundStmt> parseCompoundStmt();
-  std::unique_ptr<ReturnStmt> parseReturnStmt();
-  std::unique_ptr<IfStmt> parseIfStmt();
-  std::unique_ptr<ExprStmt> parseExprStmt();
+  Stmt *parseStmt();
+  CompoundStmt *parseCompoundStmt();
+  bool parseBlockBody(SmallVectorImpl<Stmt *> &Body);
+  LazyFunctionBody *skipFunctionBody();
+  ArrayRef<Stmt *> parseBodyIn(ASTContext &C, DiagnosticsEngine &D,
+                               uint32_t Begin, uint32_t End);
+  void parseBodiesInParallel(
+      ArrayRef<Decl *> Decls,
+      const std::optional<DiagnosticsEngine::DeferredDiagnostic> &TopLevelError);
+  ReturnStmt *parseReturnStmt();
+  IfStmt *parseIfStmt();
+  ExprStmt *parseExprStmt();
 
   // Parsing methods for expressions
-  std::unique_ptr<Expr> parseExpr();
-  std::unique_ptr<Expr> parseAssignExpr();
-  std::unique_ptr<Expr> parseEqualityExpr();
-  std::unique_ptr<Expr> parseRelationalExpr();
-  std::unique_ptr<Expr> parseAdditiveExpr();
-  std::unique_ptr<Expr> parseMultiplicativeExpr();
-  std::unique_ptr<Expr> parseUnaryExpr();
-  std::unique_ptr<Expr> parsePrimaryExpr();
-  std::unique_ptr<Expr> parseIntegerLiteral();
-  std::unique_ptr<Expr> parseFloatLiteral();
-  std::unique_ptr<CallExpr> parseCallExpr(StringRef FuncName, SMLoc Loc);
+  Expr *parseExpr();
+  Expr *parseBinOpRHS(Expr *LHS, unsigned MinPrec);
+  Expr *parseUnaryExpr();
+  Expr *parsePrimaryExpr();
+  Expr *parseIntegerLiteral();
+  Expr *parseFloatLiteral();
+  CallExpr *parseCallExpr(IdentifierInfo *FuncName, SMLoc Loc);
 
   // Helper for detecting keyword case errors
   bool checkKeywordCaseError();
 
 public:
-  Parser(Lexer &Lex, DiagnosticsEngine &Diags) : Lex(Lex), Diags(Diags) {
+  Parser(Lexer &Lex, DiagnosticsEngine &Diags, ASTContext &Ctx)
+      : Lex(Lex), Diags(&Diags), Ctx(Ctx) {
     advance(); // Prime the first token
   }
 
+  // Parses from tokens already lexed by Lex.lexAll(), starting at token
+  // StartIdx. Lex is still used to resolve token locations and spellings.
+  Parser(Lexer &Lex, const TokenStream &Tokens, DiagnosticsEngine &Diags,
+         ASTContext &Ctx, size_t StartIdx = 0)
+      : Lex(Lex), Diags(&Diags), Ctx(Ctx), Tokens(&Tokens), TokIdx(StartIdx) {
+    CurTok = Tokens[StartIdx]; // Prime the first token
+  }
+
   // Main parsing entry points
-  std::vector<std::unique_ptr<Decl>> parse();
-  std::unique_ptr<Decl> parseTopLevelDecl();
+  DeclList parse();
+  Decl *parseTopLevelDecl();
+
+  // Parses one step of parse(): a top-level declaration, or a stray token or
+  // malformed declaration that is skipped (returning nullptr).
+  Decl *parseNextTopLevelDecl();
+
+  bool atEOF() const { return CurTok.is(tok::eof); }
+
+  // In lazy-body mode a function body is only brace-matched over the token
+  // kinds and its statements are parsed on the first FunctionDecl::getBody()
+  // call, by this parser, which must outlive the AST. Errors inside a body are
+  // not reported until then. Requires a TokenStream.
+  void setLazyBodies(bool Lazy) {
+    assert((!Lazy || Tokens) && "lazy bodies require a TokenStream");
+    LazyBodies = Lazy;
+  }
+
+  // In parallel-body mode parse() first splits the input into top-level
+  // declarations as in lazy-body mode, then parses all function bodies
+  // concurrently on llvm::parallel's thread pool, each worker with its own
+  // token cursor and ASTContext::createSubContext() arena. The result is the
+  // same as a serial parse, and so is the error reported: the top-level pass
+  // stops at its first error, and that or the first error in the bodies
+  // before it, whichever comes first in the source, is reported once all of
+  // them have been parsed. Takes precedence over lazy-body mode, and requires
+  // a TokenStream.
+  void setParallelBodies(bool Parallel) {
+    assert((!Parallel || Tokens) && "parallel bodies require a TokenStream");
+    ParallelBodies = Parallel;
+  }
+
+  ArrayRef<Stmt *> parseBody(uint32_t Begin, uint32_t End) override;
+
+  // Index of the current token when parsing from a TokenStream.
+  size_t getTokenIndex() const {
+    assert(Tokens && "token index requires a TokenStream");
+    return TokIdx;
+  }
 };
 
 class ParserDriver {
   Parser Parser;
-  Lexer Lex;
-  DiagnosticsEngine Diags;
+  Lexer &Lex;
+  DiagnosticsEngine &Diags;
 
 public:
-  ParserDriver(Lexer &Lex, DiagnosticsEngine &Diags)
-      : Parser(Lex, Diags), Lex(Lex), Diags(Diags) {}
-  std::vector<std::unique_ptr<Decl>> parse() {
+  ParserDriver(Lexer &Lex, DiagnosticsEngine &Diags, ASTContext &Ctx)
+      : Parser(Lex, Diags, Ctx), Lex(Lex), Diags(Diags) {}
+  ParserDriver(Lexer &Lex, const TokenStream &Tokens, DiagnosticsEngine &Diags,
+               ASTContext &Ctx)
+      : Parser(Lex, Tokens, Diags, Ctx), Lex(Lex), Diags(Diags) {}
+  void setLazyBodies(bool Lazy) { Parser.setLazyBodies(Lazy); }
+  void setParallelBodies(bool Parallel) { Parser.setParallelBodies(Parallel); }
+  DeclList parse() {
     return Parser.parse();
   }
 };
@@ -0,0 +1,29 @@
+#ifndef TINYCC_SEMA_CONSTANTFOLDING_H
+#define TINYCC_SEMA_CONSTANTFOLDING_H
+
+#include "AST/AST.h"
+
+namespace tinycc {
+
+/// Folds the constant expressions of the AST rooted at \p Decls in place, so
+/// that code generation sees a literal wherever the value is known, e.g. in
+/// `return 2 * 3 + 4;` or the initializer of `int g = -(4 * 8);`. Also drops
+/// identity operations on ints: x + 0, 0 + x, x - 0, x * 1, 1 * x and x / 1
+/// become x, and x * 0 and 0 * x become 0 unless x has side effects.
+///
+/// Folding follows C semantics on the i32 and float values codegen uses. Ints
+/// are signed 32-bit; an operation whose result C leaves undefined (signed
+/// overflow, division by zero, INT_MIN / -1) is left for the program to
+/// evaluate rather than given a value here. Floats are folded in single
+/// precision with round-to-nearest, as the hardware would, and an int operand
+/// of a float operation is converted first. Identities are only applied to
+/// operands known to be ints, since x + 0 is not x for a float x of -0.0.
+///
+/// New nodes are allocated in \p C. Returns the number of expressions
+/// replaced. Function bodies skipped by a lazy-body parse are parsed on the
+/// way.
+unsigned foldConstants(ArrayRef<Decl *> Decls, ASTContext &C);
+
+} // namespace tinycc
+
+#endif // TINYCC_SEMA_CONSTANTFOLDING_H
@@ -6,6 +6,10 @@
 #include "llvm/Support/SMLoc.h"
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/raw_ostream.h"
+#include <atomic>
+#include <mutex>
+#include <optional>
+#include <string>
 #include <utility>
 
 using namespace llvm;
@@ -20,14 +24,45 @@ enum {
 } // namespace diag
 
 class DiagnosticsEngine {
+public:
+  // A diagnostic kept by a deferring engine instead of being printed
+  struct DeferredDiagnostic {
+    SMLoc Loc;
+    SourceMgr::DiagKind Kind;
+    std::string Msg;
+  };
 
+private:
   SourceMgr &SrcMgr;
-  unsigned NumErrors;
+  std::atomic<unsigned> NumErrors;
+
+  // Serializes report() so that diagnostics from worker threads don't
+  // interleave and the first error is the one printed before exiting.
+  std::mutex ReportLock;
+
+  // A deferring engine keeps its first diagnostic in FirstDeferred rather
+  // than printing it and exiting. Worker threads report through one each,
+  // so that the error printed is the first in the source, not the first
+  // some thread reaches.
+  bool Deferring;
+  std::optional<DeferredDiagnostic> FirstDeferred;
+
+  [[noreturn]] void print(SMLoc Loc, SourceMgr::DiagKind Kind,
+                          StringRef Msg) {
+    std::lock_guard<std::mutex> Guard(ReportLock);
+    SrcMgr.PrintMessage(Loc, Kind, Msg);
+    exit(1);
+  }
 
 public:
-  DiagnosticsEngine(llvm::SourceMgr &SrcMgr) : SrcMgr(SrcMgr), NumErrors(0) {}
+  DiagnosticsEngine(llvm::SourceMgr &SrcMgr, bool Deferring = false)
+      : SrcMgr(SrcMgr), NumErrors(0), Deferring(Deferring) {}
 
+  SourceMgr &getSourceMgr() { return SrcMgr; }
   unsigned numErrors() { return NumErrors; }
+  const std::optional<DeferredDiagnostic> &getFirstDeferred() const {
+    return FirstDeferred;
+  }
   static const char *getDiagnosticText(unsigned DiagID);
   static SourceMgr::DiagKind getDiagnosticKind(unsigned DiagID);
   template <typename... Args>
@@ -36,9 +71,16 @@ public:
                                     std::forward<Args>(Arguments)...)
                           .str();
     SourceMgr::DiagKind Kind = getDiagnosticKind(DiagID);
-    SrcMgr.PrintMessage(Loc, Kind, Msg);
     NumErrors += (Kind == SourceMgr::DK_Error);
-    exit(1);
+    if (!Deferring)
+      print(Loc, Kind, Msg);
+    if (!FirstDeferred)
+      FirstDeferred = DeferredDiagnostic{Loc, Kind, std::move(Msg)};
+  }
+
+  // Print a diagnostic kept by a deferring engine, and exit
+  [[noreturn]] void report(const DeferredDiagnostic &D) {
+    print(D.Loc, D.Kind, D.Msg);
   }
 };
 
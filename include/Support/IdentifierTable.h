@@ -0,0 +1,77 @@
+#ifndef TINYCC_SUPPORT_IDENTIFIERTABLE_H
+#define TINYCC_SUPPORT_IDENTIFIERTABLE_H
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Allocator.h"
+#include <mutex>
+#include <shared_mutex>
+
+namespace tinycc {
+
+/// The unique record for one identifier spelling. There is exactly one
+/// IdentifierInfo per spelling in an IdentifierTable, so two identifiers are
+/// the same name iff their IdentifierInfo pointers (or IDs) are equal.
+class IdentifierInfo {
+  friend class IdentifierTable;
+
+  /// The spelling, owned by the table.
+  llvm::StringRef Name;
+
+  /// A dense index, in order of first appearance.
+  unsigned ID = 0;
+
+public:
+  llvm::StringRef getName() const { return Name; }
+  unsigned getID() const { return ID; }
+};
+
+/// Interns identifier spellings. Entries are bump allocated and never move, so
+/// IdentifierInfo pointers stay valid for the lifetime of the table.
+class IdentifierTable {
+  llvm::StringMap<IdentifierInfo, llvm::BumpPtrAllocator> Table;
+
+  /// Guards Table while in concurrent mode.
+  std::shared_mutex Mutex;
+  bool Concurrent = false;
+
+  IdentifierInfo &insert(llvm::StringRef Name) {
+    auto Result = Table.try_emplace(Name);
+    IdentifierInfo &II = Result.first->second;
+    if (Result.second) {
+      II.Name = Result.first->getKey();
+      II.ID = Table.size() - 1;
+    }
+    return II;
+  }
+
+public:
+  IdentifierTable() = default;
+  IdentifierTable(const IdentifierTable &) = delete;
+  IdentifierTable &operator=(const IdentifierTable &) = delete;
+
+  /// Makes get() safe to call from several threads at once, at the cost of a
+  /// lock per call. Must not be toggled while other threads use the table.
+  void setConcurrent(bool Enable) { Concurrent = Enable; }
+
+  /// Returns the unique IdentifierInfo for \p Name, creating it on first use.
+  IdentifierInfo &get(llvm::StringRef Name) {
+    if (!Concurrent)
+      return insert(Name);
+    {
+      std::shared_lock<std::shared_mutex> Lock(Mutex);
+      auto It = Table.find(Name);
+      if (It != Table.end())
+        return It->second;
+    }
+    std::unique_lock<std::shared_mutex> Lock(Mutex);
+    return insert(Name);
+  }
+
+  /// Number of distinct identifiers interned so far.
+  unsigned size() const { return Table.size(); }
+};
+
+} // namespace tinycc
+
+#endif // TINYCC_SUPPORT_IDENTIFIERTABLE_H
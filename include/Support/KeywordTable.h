@@ -0,0 +1,147 @@
+#ifndef TINYCC_SUPPORT_KEYWORDTABLE_H
+#define TINYCC_SUPPORT_KEYWORDTABLE_H
+
+#include "Support/TokenKinds.h"
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <llvm/ADT/StringRef.h>
+
+namespace tinycc {
+namespace tok {
+
+namespace detail {
+struct KeywordInfo {
+  const char *Spelling;
+  unsigned Length;
+  TokenKind Kind;
+};
+
+inline constexpr KeywordInfo KeywordList[] = {
+#define KEYWORD(NAME, FLAGS) {#NAME, sizeof(#NAME) - 1, kw_##NAME},
+#include "Support/TokenKinds.def"
+};
+
+inline constexpr unsigned NumKeywords =
+    sizeof(KeywordList) / sizeof(KeywordList[0]);
+
+constexpr unsigned getTableBits() {
+  unsigned Bits = 1;
+  while ((1u << Bits) < 2 * NumKeywords)
+    ++Bits;
+  return Bits;
+}
+
+inline constexpr unsigned KeywordTableBits = getTableBits();
+inline constexpr unsigned KeywordTableSize = 1u << KeywordTableBits;
+
+constexpr unsigned getMinKeywordLength() {
+  unsigned Min = ~0u;
+  for (const KeywordInfo &KW : KeywordList)
+    Min = KW.Length < Min ? KW.Length : Min;
+  return Min;
+}
+
+constexpr unsigned getMaxKeywordLength() {
+  unsigned Max = 0;
+  for (const KeywordInfo &KW : KeywordList)
+    Max = KW.Length > Max ? KW.Length : Max;
+  return Max;
+}
+
+inline constexpr unsigned MinKeywordLength = getMinKeywordLength();
+inline constexpr unsigned MaxKeywordLength = getMaxKeywordLength();
+
+/// Folds ASCII letters to lower case. Other characters may change too, but all
+/// keywords are lower case and every probe ends in a full compare, so that only
+/// costs a wasted probe.
+constexpr unsigned char foldCase(unsigned char C) { return C | 0x20; }
+
+/// Hashes a spelling by its length and its case-folded first and last
+/// characters, which is enough to tell every keyword apart once a suitable
+/// multiplier is found. Folding lets the same table answer case-insensitive
+/// lookups.
+constexpr unsigned hashKeyword(uint32_t Seed, unsigned Length,
+                               unsigned char First, unsigned char Last) {
+  uint32_t Key = foldCase(First) | (uint32_t(foldCase(Last)) << 8) |
+                 (uint32_t(Length) << 16);
+  return uint32_t(Key * Seed) >> (32 - KeywordTableBits);
+}
+
+/// Searches for a multiplier that maps every keyword to its own slot.
+constexpr uint32_t findKeywordSeed() {
+  for (uint32_t I = 1; I != 4096; ++I) {
+    uint32_t Seed = I * 0x9E3779B1u;
+    bool Used[KeywordTableSize] = {};
+    bool Collision = false;
+    for (const KeywordInfo &KW : KeywordList) {
+      unsigned H = hashKeyword(Seed, KW.Length, KW.Spelling[0],
+                               KW.Spelling[KW.Length - 1]);
+      Collision |= Used[H];
+      Used[H] = true;
+    }
+    if (!Collision)
+      return Seed;
+  }
+  return 0;
+}
+
+inline constexpr uint32_t KeywordSeed = findKeywordSeed();
+static_assert(KeywordSeed != 0,
+              "no perfect hash seed for the keywords in TokenKinds.def");
+
+constexpr std::array<signed char, KeywordTableSize> buildKeywordTable() {
+  std::array<signed char, KeywordTableSize> Table{};
+  for (unsigned I = 0; I != KeywordTableSize; ++I)
+    Table[I] = -1;
+  for (unsigned I = 0; I != NumKeywords; ++I) {
+    const KeywordInfo &KW = KeywordList[I];
+    Table[hashKeyword(KeywordSeed, KW.Length, KW.Spelling[0],
+                      KW.Spelling[KW.Length - 1])] = static_cast<signed char>(I);
+  }
+  return Table;
+}
+
+inline constexpr std::array<signed char, KeywordTableSize> KeywordTable =
+    buildKeywordTable();
+
+/// Returns the keyword that \p Name could be, going by the hash alone.
+inline const KeywordInfo *probeKeyword(llvm::StringRef Name) {
+  unsigned Length = Name.size();
+  if (Length < MinKeywordLength || Length > MaxKeywordLength)
+    return nullptr;
+  int Idx = KeywordTable[hashKeyword(KeywordSeed, Length, Name.front(),
+                                     Name.back())];
+  if (Idx < 0)
+    return nullptr;
+  const KeywordInfo &KW = KeywordList[Idx];
+  return KW.Length == Length ? &KW : nullptr;
+}
+} // namespace detail
+
+/// Returns the keyword kind spelled by \p Name, or \p Default if \p Name is not
+/// a keyword. The table is built at compile time from TokenKinds.def, so this
+/// never allocates and costs one probe plus one compare.
+inline TokenKind getKeywordKind(llvm::StringRef Name,
+                                TokenKind Default = tok::unknown) {
+  const detail::KeywordInfo *KW = detail::probeKeyword(Name);
+  if (!KW || std::memcmp(KW->Spelling, Name.data(), KW->Length))
+    return Default;
+  return KW->Kind;
+}
+
+/// Like getKeywordKind(), but ignoring case, so that e.g. "Int" and "RETURN"
+/// find kw_int and kw_return. Uses the same table and costs the same single
+/// probe.
+inline TokenKind getKeywordKindIgnoreCase(llvm::StringRef Name,
+                                          TokenKind Default = tok::unknown) {
+  const detail::KeywordInfo *KW = detail::probeKeyword(Name);
+  if (!KW || !Name.equals_insensitive(KW->Spelling))
+    return Default;
+  return KW->Kind;
+}
+
+} // namespace tok
+} // namespace tinycc
+
+#endif // TINYCC_SUPPORT_KEYWORDTABLE_H
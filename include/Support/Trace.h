@@ -0,0 +1,76 @@
+#ifndef TINYCC_SUPPORT_TRACE_H
+#define TINYCC_SUPPORT_TRACE_H
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+#include <atomic>
+#include <memory>
+
+// Trace points are compiled in by default only when assertions are, so release
+// builds pay nothing for them. Configure with -DENABLE_TRACE=ON|OFF to choose.
+#ifndef TINYCC_ENABLE_TRACE
+#ifdef NDEBUG
+#define TINYCC_ENABLE_TRACE 0
+#else
+#define TINYCC_ENABLE_TRACE 1
+#endif
+#endif
+
+namespace tinycc {
+namespace trace {
+
+enum Category : unsigned {
+#define TRACE_CATEGORY(ID, Name) ID##Index,
+#include "Support/TraceCategories.def"
+  NumCategories
+};
+
+namespace detail {
+/// Bit I is set when category I is enabled.
+extern std::atomic<unsigned> EnabledMask;
+} // namespace detail
+
+inline bool isEnabled(Category C) {
+  return detail::EnabledMask.load(std::memory_order_relaxed) & (1u << C);
+}
+
+/// Enables the categories named in the comma separated list \p Spec, e.g.
+/// "lexer,parser". "all" enables every category. Returns false and sets
+/// \p Unknown to the offending name if a category does not exist.
+bool enable(llvm::StringRef Spec, llvm::StringRef &Unknown);
+
+/// Sends trace output to \p OS. By default it goes to a buffered stream on
+/// stderr so it never mixes with the compiler's regular output.
+void setSink(std::unique_ptr<llvm::raw_ostream> OS);
+
+/// Collects one trace line and writes it to the sink, under a lock so that
+/// lines from concurrent lexer chunks don't interleave.
+class Line {
+  Category C;
+  llvm::SmallString<128> Buffer;
+
+public:
+  llvm::raw_svector_ostream OS;
+
+  explicit Line(Category C) : C(C), OS(Buffer) {}
+  ~Line();
+};
+
+} // namespace trace
+} // namespace tinycc
+
+/// Writes one line to the trace sink if \p CAT (Lexer, Parser, ...) is enabled,
+/// for example: TINYCC_TRACE(Lexer, "number " << Spelling). The arguments are
+/// not evaluated unless the category is enabled, and the whole statement is
+/// dead code when TINYCC_ENABLE_TRACE is 0.
+#define TINYCC_TRACE(CAT, ...)                                                 \
+  do {                                                                         \
+    if (TINYCC_ENABLE_TRACE &&                                                 \
+        ::tinycc::trace::isEnabled(::tinycc::trace::CAT##Index)) {             \
+      ::tinycc::trace::Line TraceLine(::tinycc::trace::CAT##Index);            \
+      TraceLine.OS << __VA_ARGS__;                                             \
+    }                                                                          \
+  } while (false)
+
+#endif // TINYCC_SUPPORT_TRACE_H
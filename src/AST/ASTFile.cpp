@@ -0,0 +1,386 @@
+#include "AST/ASTFile.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/Endian.h"
+
+using namespace tinycc;
+using namespace llvm::support::endian;
+
+// Layout: a header of the magic, the version and the element count of each
+// section, then the sections in this order, each padded to 8 bytes:
+//
+//   Nodes     16 bytes: u8 kind, u8 op, u16 type, u32 A, B, C
+//   Lists     u32 node index
+//   TopLevel  u32 node index
+//   Names     u32 offset and u32 length in Strings
+//   Types     u32 offset and u32 length in Strings
+//   Ints      u64 value, u32 bit width, u32 is-unsigned
+//   Floats    u32 semantics (0 single, 1 double), u32 zero, u64 bits
+//   Strings   bytes
+//
+// All integers are little-endian.
+
+namespace {
+constexpr char Magic[4] = {'T', 'C', 'A', 'S'};
+
+enum Section { Nodes, Lists, TopLevel, Names, Types, Ints, Floats, Strings };
+constexpr unsigned NumSections = Strings + 1;
+constexpr uint64_t ElementSize[NumSections] = {16, 4, 4, 8, 8, 16, 16, 1};
+constexpr uint64_t HeaderSize = 8 + 4 * NumSections;
+
+uint64_t alignTo8(uint64_t N) { return (N + 7) & ~uint64_t(7); }
+
+enum FloatSemantics : uint32_t { FS_Single, FS_Double };
+} // namespace
+
+namespace tinycc {
+
+class ASTFileWriter {
+  const FlatAST &AST;
+  std::string Out;
+  std::string StringTable;
+
+  void emit16(uint16_t V) {
+    char Buf[2];
+    write16le(Buf, V);
+    Out.append(Buf, 2);
+  }
+  void emit32(uint32_t V) {
+    char Buf[4];
+    write32le(Buf, V);
+    Out.append(Buf, 4);
+  }
+  void emit64(uint64_t V) {
+    char Buf[8];
+    write64le(Buf, V);
+    Out.append(Buf, 8);
+  }
+  void pad() { Out.resize(alignTo8(Out.size())); }
+
+  void emitString(StringRef S) {
+    emit32(StringTable.size());
+    emit32(S.size());
+    StringTable += S;
+  }
+
+public:
+  explicit ASTFileWriter(const FlatAST &AST) : AST(AST) {}
+
+  void write(llvm::raw_ostream &OS) {
+    Out.append(Magic, sizeof(Magic));
+    emit32(astfile::Version);
+    for (uint32_t Count : {AST.Nodes.size(), AST.Lists.size(),
+                           AST.TopLevel.size(), AST.Names.size(),
+                           AST.Types.size(), AST.Ints.size(),
+                           AST.Floats.size()})
+      emit32(Count);
+    size_t StringCountPos = Out.size();
+    emit32(0); // String bytes, patched below.
+    pad();
+
+    for (const FlatAST::Node &N : AST.Nodes) {
+      Out += char(N.Kind);
+      Out += char(N.Op);
+      emit16(N.Type);
+      emit32(N.A);
+      emit32(N.B);
+      emit32(N.C);
+    }
+    for (uint32_t I : AST.Lists)
+      emit32(I);
+    pad();
+    for (uint32_t I : AST.TopLevel)
+      emit32(I);
+    pad();
+    for (IdentifierInfo *II : AST.Names)
+      emitString(II->getName());
+    for (StringRef Type : AST.Types)
+      emitString(Type);
+    for (const llvm::APSInt &V : AST.Ints) {
+      emit64(V.getZExtValue());
+      emit32(V.getBitWidth());
+      emit32(V.isUnsigned());
+    }
+    for (const llvm::APFloat &V : AST.Floats) {
+      bool Single = &V.getSemantics() == &llvm::APFloat::IEEEsingle();
+      assert((Single || &V.getSemantics() == &llvm::APFloat::IEEEdouble()) &&
+             "unsupported float semantics");
+      emit32(Single ? FS_Single : FS_Double);
+      emit32(0);
+      emit64(V.bitcastToAPInt().getZExtValue());
+    }
+    Out += StringTable;
+    pad();
+    write32le(&Out[StringCountPos], StringTable.size());
+    OS << Out;
+  }
+};
+
+class ASTFileReader {
+  StringRef Data;
+  IdentifierTable &Idents;
+  uint32_t Count[NumSections];
+  const char *Start[NumSections];
+  FlatAST AST;
+
+  llvm::Error error(const llvm::Twine &Msg) {
+    return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                   "invalid AST file: " + Msg);
+  }
+
+  llvm::Expected<StringRef> readString(const char *P) {
+    uint64_t Offset = read32le(P), Length = read32le(P + 4);
+    if (Offset + Length > Count[Strings])
+      return error("string out of range");
+    return StringRef(Start[Strings] + Offset, Length);
+  }
+
+  bool isExpr(uint32_t I, uint32_t Parent) const {
+    if (I <= Parent || I >= AST.Nodes.size())
+      return false;
+    switch (AST.Nodes[I].Kind) {
+    case FlatAST::NK_IntegerLiteral:
+    case FlatAST::NK_FloatLiteral:
+    case FlatAST::NK_VarRef:
+    case FlatAST::NK_Binary:
+    case FlatAST::NK_Unary:
+    case FlatAST::NK_Call:
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  bool isStmt(uint32_t I, uint32_t Parent) const {
+    if (I <= Parent || I >= AST.Nodes.size())
+      return false;
+    switch (AST.Nodes[I].Kind) {
+    case FlatAST::NK_ExprStmt:
+    case FlatAST::NK_ReturnStmt:
+    case FlatAST::NK_IfStmt:
+    case FlatAST::NK_CompoundStmt:
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  bool isKind(uint32_t I, uint32_t Parent, FlatAST::NodeKind Kind) const {
+    return I > Parent && I < AST.Nodes.size() && AST.Nodes[I].Kind == Kind;
+  }
+
+  bool isList(uint32_t Begin, uint32_t Length) const {
+    return uint64_t(Begin) + Length <= AST.Lists.size();
+  }
+
+  // Appends the children of N to Children, in the order they are laid out
+  void getChildren(const FlatAST::Node &N,
+                   llvm::SmallVectorImpl<uint32_t> &Children) const {
+    auto AddIf = [&](uint32_t Child) {
+      if (Child != FlatAST::NoNode)
+        Children.push_back(Child);
+    };
+    switch (N.Kind) {
+    case FlatAST::NK_Function:
+      Children.append(AST.getParams(N).begin(), AST.getParams(N).end());
+      Children.push_back(AST.getBody(N));
+      break;
+    case FlatAST::NK_Var:
+      AddIf(N.B);
+      break;
+    case FlatAST::NK_ExprStmt:
+    case FlatAST::NK_ReturnStmt:
+    case FlatAST::NK_Unary:
+      AddIf(N.A);
+      break;
+    case FlatAST::NK_IfStmt:
+      Children.append({N.A, N.B});
+      AddIf(N.C);
+      break;
+    case FlatAST::NK_Binary:
+      Children.append({N.A, N.B});
+      break;
+    case FlatAST::NK_CompoundStmt:
+    case FlatAST::NK_Call:
+      Children.append(AST.getChildList(N).begin(), AST.getChildList(N).end());
+      break;
+    case FlatAST::NK_Param:
+    case FlatAST::NK_IntegerLiteral:
+    case FlatAST::NK_FloatLiteral:
+    case FlatAST::NK_VarRef:
+      break;
+    }
+  }
+
+  // Checks that node I is well formed, so that walking the AST can't index
+  // out of range or see a node of the wrong category. Children must come
+  // after their parent, which rules out cycles; read() checks the rest of
+  // the layout.
+  bool isValidNode(uint32_t I) const {
+    const FlatAST::Node &N = AST.Nodes[I];
+    auto AllOf = [&](ArrayRef<uint32_t> List, auto Pred) {
+      for (uint32_t Child : List)
+        if (!Pred(Child))
+          return false;
+      return true;
+    };
+    auto IsExpr = [&](uint32_t Child) { return isExpr(Child, I); };
+    auto IsStmt = [&](uint32_t Child) { return isStmt(Child, I); };
+    auto IsParam = [&](uint32_t Child) {
+      return isKind(Child, I, FlatAST::NK_Param);
+    };
+    bool HasName = N.A < AST.Names.size();
+    bool HasType = N.Type < AST.Types.size();
+
+    switch (N.Kind) {
+    case FlatAST::NK_Function:
+      return HasName && HasType && N.C != ~0u && isList(N.B, N.C + 1) &&
+             AllOf(AST.getParams(N), IsParam) &&
+             isKind(AST.getBody(N), I, FlatAST::NK_CompoundStmt);
+    case FlatAST::NK_Param:
+      return HasName && HasType;
+    case FlatAST::NK_Var:
+      return HasName && HasType && (N.B == FlatAST::NoNode || IsExpr(N.B));
+    case FlatAST::NK_ExprStmt:
+      return IsExpr(N.A);
+    case FlatAST::NK_ReturnStmt:
+      return N.A == FlatAST::NoNode || IsExpr(N.A);
+    case FlatAST::NK_IfStmt:
+      return IsExpr(N.A) && IsStmt(N.B) &&
+             (N.C == FlatAST::NoNode || IsStmt(N.C));
+    case FlatAST::NK_CompoundStmt:
+      return isList(N.B, N.C) && AllOf(AST.getChildList(N), IsStmt);
+    case FlatAST::NK_IntegerLiteral:
+      return N.A < AST.Ints.size();
+    case FlatAST::NK_FloatLiteral:
+      return N.A < AST.Floats.size();
+    case FlatAST::NK_VarRef:
+      return HasName;
+    case FlatAST::NK_Binary:
+      // BO_Eq and UO_Not are the last opcodes.
+      return N.Op <= BinaryExpr::BO_Eq && IsExpr(N.A) && IsExpr(N.B);
+    case FlatAST::NK_Unary:
+      return N.Op <= UnaryExpr::UO_Not && IsExpr(N.A);
+    case FlatAST::NK_Call:
+      return HasName && isList(N.B, N.C) &&
+             AllOf(AST.getChildList(N), IsExpr);
+    }
+    return false;
+  }
+
+public:
+  ASTFileReader(llvm::MemoryBufferRef Buffer, IdentifierTable &Idents)
+      : Data(Buffer.getBuffer()), Idents(Idents) {}
+
+  llvm::Expected<FlatAST> read() {
+    if (Data.size() < HeaderSize || Data.substr(0, 4) != StringRef(Magic, 4))
+      return error("bad magic");
+    if (uint32_t V = read32le(Data.data() + 4); V != astfile::Version)
+      return error("version " + llvm::Twine(V) + ", expected " +
+                   llvm::Twine(astfile::Version));
+
+    uint64_t Offset = alignTo8(HeaderSize);
+    for (unsigned S = 0; S != NumSections; ++S) {
+      Count[S] = read32le(Data.data() + 8 + 4 * S);
+      Start[S] = Data.data() + Offset;
+      Offset = alignTo8(Offset + Count[S] * ElementSize[S]);
+      if (Offset > Data.size())
+        return error("truncated");
+    }
+
+    AST.Nodes.resize(Count[Nodes]);
+    for (uint32_t I = 0; I != Count[Nodes]; ++I) {
+      const char *P = Start[Nodes] + 16 * I;
+      FlatAST::Node &N = AST.Nodes[I];
+      if (uint8_t(P[0]) >= FlatAST::NumNodeKinds)
+        return error("bad node kind");
+      N.Kind = FlatAST::NodeKind(P[0]);
+      N.Op = P[1];
+      N.Type = read16le(P + 2);
+      N.A = read32le(P + 4);
+      N.B = read32le(P + 8);
+      N.C = read32le(P + 12);
+    }
+    for (uint32_t I = 0; I != Count[Lists]; ++I)
+      AST.Lists.push_back(read32le(Start[Lists] + 4 * I));
+
+    for (uint32_t I = 0; I != Count[Names]; ++I) {
+      llvm::Expected<StringRef> Name = readString(Start[Names] + 8 * I);
+      if (!Name)
+        return Name.takeError();
+      AST.Names.push_back(&Idents.get(*Name));
+    }
+    for (uint32_t I = 0; I != Count[Types]; ++I) {
+      llvm::Expected<StringRef> Type = readString(Start[Types] + 8 * I);
+      if (!Type)
+        return Type.takeError();
+      AST.Types.push_back(*Type);
+    }
+    for (uint32_t I = 0; I != Count[Ints]; ++I) {
+      const char *P = Start[Ints] + 16 * I;
+      uint32_t Width = read32le(P + 8);
+      if (Width == 0 || Width > 64)
+        return error("bad integer width");
+      AST.Ints.emplace_back(llvm::APInt(Width, read64le(P)),
+                            read32le(P + 12) != 0);
+    }
+    for (uint32_t I = 0; I != Count[Floats]; ++I) {
+      const char *P = Start[Floats] + 16 * I;
+      uint32_t Sem = read32le(P);
+      if (Sem != FS_Single && Sem != FS_Double)
+        return error("bad float semantics");
+      if (Sem == FS_Single)
+        AST.Floats.emplace_back(llvm::APFloat::IEEEsingle(),
+                                llvm::APInt(32, read64le(P + 8)));
+      else
+        AST.Floats.emplace_back(llvm::APFloat::IEEEdouble(),
+                                llvm::APInt(64, read64le(P + 8)));
+    }
+
+    // The nodes must be in pre-order: a node's first child right after it,
+    // and each later child where the previous child's subtree ends. This
+    // also rules out a node shared by several parents, which toDecls() would
+    // copy once per parent, exponentially many times for a chain of them.
+    // Children come after their parents, so subtree ends are found bottom-up.
+    std::vector<uint32_t> SubtreeEnd(Count[Nodes]);
+    llvm::SmallVector<uint32_t, 8> Children;
+    for (uint32_t I = Count[Nodes]; I-- != 0;) {
+      if (!isValidNode(I))
+        return error("malformed node " + llvm::Twine(I));
+      Children.clear();
+      getChildren(AST.Nodes[I], Children);
+      uint32_t Next = I + 1;
+      for (uint32_t Child : Children) {
+        if (Child != Next)
+          return error("node " + llvm::Twine(I) + " is not in pre-order");
+        Next = SubtreeEnd[Child];
+      }
+      SubtreeEnd[I] = Next;
+    }
+
+    // Likewise the top-level declarations must cover all the nodes, in order
+    uint32_t Next = 0;
+    for (uint32_t I = 0; I != Count[TopLevel]; ++I) {
+      uint32_t D = read32le(Start[TopLevel] + 4 * I);
+      if (D != Next || (AST.Nodes[D].Kind != FlatAST::NK_Function &&
+                        AST.Nodes[D].Kind != FlatAST::NK_Var))
+        return error("bad top-level declaration");
+      AST.TopLevel.push_back(D);
+      Next = SubtreeEnd[D];
+    }
+    if (Next != Count[Nodes])
+      return error("nodes outside the top-level declarations");
+    return std::move(AST);
+  }
+};
+
+} // namespace tinycc
+
+void astfile::write(const FlatAST &AST, llvm::raw_ostream &OS) {
+  ASTFileWriter(AST).write(OS);
+}
+
+llvm::Expected<FlatAST> astfile::read(llvm::MemoryBufferRef Buffer,
+                                      IdentifierTable &Idents) {
+  return ASTFileReader(Buffer, Idents).read();
+}
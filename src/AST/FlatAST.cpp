@@ -0,0 +1,316 @@
+#include "AST/FlatAST.h"
+#include "AST/StmtVisitor.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/Casting.h"
+
+using namespace tinycc;
+
+namespace tinycc {
+
+// Converts a pointer-based AST to a FlatAST, in pre-order.
+class FlatASTBuilder : public StmtVisitor<FlatASTBuilder, uint32_t>,
+                       public ExprVisitor<FlatASTBuilder, uint32_t> {
+  FlatAST &AST;
+  llvm::DenseMap<IdentifierInfo *, uint32_t> NameIndex;
+  llvm::DenseMap<StringRef, uint16_t> TypeIndex;
+
+  uint32_t addNode(FlatAST::NodeKind Kind, SMLoc Loc) {
+    AST.Nodes.push_back({Kind, 0, 0, 0, 0, 0});
+    AST.Locs.push_back(Loc);
+    return AST.Nodes.size() - 1;
+  }
+
+  uint32_t addName(IdentifierInfo *II) {
+    auto Result = NameIndex.try_emplace(II, AST.Names.size());
+    if (Result.second)
+      AST.Names.push_back(II);
+    return Result.first->second;
+  }
+
+  uint16_t addType(StringRef Type) {
+    auto Result = TypeIndex.try_emplace(Type, AST.Types.size());
+    if (Result.second)
+      AST.Types.push_back(Type);
+    return Result.first->second;
+  }
+
+  uint32_t addList(ArrayRef<uint32_t> List) {
+    uint32_t Start = AST.Lists.size();
+    AST.Lists.insert(AST.Lists.end(), List.begin(), List.end());
+    return Start;
+  }
+
+  uint32_t convertStmts(ArrayRef<Stmt *> Stmts, uint32_t I);
+
+public:
+  using StmtVisitor::visit;
+  using ExprVisitor::visit;
+
+  uint32_t convertDecl(Decl *D);
+
+  // Statements carry no location of their own.
+  uint32_t visitExprStmt(ExprStmt *S);
+  uint32_t visitReturnStmt(ReturnStmt *S);
+  uint32_t visitIfStmt(IfStmt *S);
+  uint32_t visitCompoundStmt(CompoundStmt *S);
+
+  uint32_t visitIntegerLiteral(IntegerLiteral *E);
+  uint32_t visitFloatLiteral(FloatLiteral *E);
+  uint32_t visitVarRefExpr(VarRefExpr *E);
+  uint32_t visitBinaryExpr(BinaryExpr *E);
+  uint32_t visitUnaryExpr(UnaryExpr *E);
+  uint32_t visitCallExpr(CallExpr *E);
+
+  explicit FlatASTBuilder(FlatAST &AST) : AST(AST) {}
+
+  void build(ArrayRef<Decl *> Decls) {
+    for (Decl *D : Decls)
+      AST.TopLevel.push_back(convertDecl(D));
+
+    // The encoding is immutable from here on.
+    AST.Nodes.shrink_to_fit();
+    AST.Locs.shrink_to_fit();
+    AST.Lists.shrink_to_fit();
+    AST.Ints.shrink_to_fit();
+    AST.Floats.shrink_to_fit();
+  }
+};
+
+} // namespace tinycc
+
+uint32_t FlatASTBuilder::convertDecl(Decl *D) {
+  if (auto *FD = dyn_cast<FunctionDecl>(D)) {
+    uint32_t I = addNode(FlatAST::NK_Function, FD->getLocation());
+    SmallVector<uint32_t, 8> List;
+    for (ParamDecl *P : FD->getParams()) {
+      uint32_t PI = addNode(FlatAST::NK_Param, P->getLocation());
+      AST.Nodes[PI].Type = addType(P->getType());
+      AST.Nodes[PI].A = addName(P->getIdentifier());
+      List.push_back(PI);
+    }
+
+    List.push_back(convertStmts(
+        FD->getBody(), addNode(FlatAST::NK_CompoundStmt, FD->getLocation())));
+
+    FlatAST::Node &N = AST.Nodes[I];
+    N.Type = addType(FD->getReturnType());
+    N.A = addName(FD->getIdentifier());
+    N.B = addList(List);
+    N.C = FD->getParams().size();
+    return I;
+  }
+
+  auto *VD = cast<VarDecl>(D);
+  uint32_t I = addNode(FlatAST::NK_Var, VD->getLocation());
+  uint32_t Init = VD->getInit() ? visit(VD->getInit()) : FlatAST::NoNode;
+  FlatAST::Node &N = AST.Nodes[I];
+  N.Type = addType(VD->getType());
+  N.A = addName(VD->getIdentifier());
+  N.B = Init;
+  return I;
+}
+
+// Fills in the statement list of CompoundStmt node I
+uint32_t FlatASTBuilder::convertStmts(ArrayRef<Stmt *> Stmts, uint32_t I) {
+  SmallVector<uint32_t, 16> List;
+  for (Stmt *S : Stmts)
+    List.push_back(visit(S));
+  AST.Nodes[I].B = addList(List);
+  AST.Nodes[I].C = List.size();
+  return I;
+}
+
+uint32_t FlatASTBuilder::visitExprStmt(ExprStmt *S) {
+  uint32_t I = addNode(FlatAST::NK_ExprStmt, SMLoc());
+  uint32_t E = visit(S->getExpr());
+  AST.Nodes[I].A = E;
+  return I;
+}
+
+uint32_t FlatASTBuilder::visitReturnStmt(ReturnStmt *S) {
+  uint32_t I = addNode(FlatAST::NK_ReturnStmt, SMLoc());
+  uint32_t E = S->getRetVal() ? visit(S->getRetVal()) : FlatAST::NoNode;
+  AST.Nodes[I].A = E;
+  return I;
+}
+
+uint32_t FlatASTBuilder::visitIfStmt(IfStmt *S) {
+  uint32_t I = addNode(FlatAST::NK_IfStmt, SMLoc());
+  uint32_t Cond = visit(S->getCond());
+  uint32_t Then = visit(S->getThen());
+  uint32_t Else = S->getElse() ? visit(S->getElse()) : FlatAST::NoNode;
+  FlatAST::Node &N = AST.Nodes[I];
+  N.A = Cond;
+  N.B = Then;
+  N.C = Else;
+  return I;
+}
+
+uint32_t FlatASTBuilder::visitCompoundStmt(CompoundStmt *S) {
+  return convertStmts(S->getBody(),
+                      addNode(FlatAST::NK_CompoundStmt, SMLoc()));
+}
+
+uint32_t FlatASTBuilder::visitIntegerLiteral(IntegerLiteral *E) {
+  uint32_t I = addNode(FlatAST::NK_IntegerLiteral, E->getLocation());
+  AST.Nodes[I].A = AST.Ints.size();
+  AST.Ints.push_back(E->getValue());
+  return I;
+}
+
+uint32_t FlatASTBuilder::visitFloatLiteral(FloatLiteral *E) {
+  uint32_t I = addNode(FlatAST::NK_FloatLiteral, E->getLocation());
+  AST.Nodes[I].A = AST.Floats.size();
+  AST.Floats.push_back(E->getValue());
+  return I;
+}
+
+uint32_t FlatASTBuilder::visitVarRefExpr(VarRefExpr *E) {
+  uint32_t I = addNode(FlatAST::NK_VarRef, E->getLocation());
+  AST.Nodes[I].A = addName(E->getIdentifier());
+  return I;
+}
+
+uint32_t FlatASTBuilder::visitBinaryExpr(BinaryExpr *E) {
+  uint32_t I = addNode(FlatAST::NK_Binary, E->getLocation());
+  uint32_t LHS = visit(E->getLeft());
+  uint32_t RHS = visit(E->getRight());
+  FlatAST::Node &N = AST.Nodes[I];
+  N.Op = E->getOpcode();
+  N.A = LHS;
+  N.B = RHS;
+  return I;
+}
+
+uint32_t FlatASTBuilder::visitUnaryExpr(UnaryExpr *E) {
+  uint32_t I = addNode(FlatAST::NK_Unary, E->getLocation());
+  uint32_t Sub = visit(E->getSubExpr());
+  AST.Nodes[I].Op = E->getOpcode();
+  AST.Nodes[I].A = Sub;
+  return I;
+}
+
+uint32_t FlatASTBuilder::visitCallExpr(CallExpr *E) {
+  uint32_t I = addNode(FlatAST::NK_Call, E->getLocation());
+  SmallVector<uint32_t, 8> Args;
+  for (Expr *Arg : E->getArgs())
+    Args.push_back(visit(Arg));
+  FlatAST::Node &N = AST.Nodes[I];
+  N.A = addName(E->getCalleeIdentifier());
+  N.B = addList(Args);
+  N.C = Args.size();
+  return I;
+}
+
+namespace {
+// Rebuilds the pointer-based AST from a FlatAST.
+class DeclExpander {
+  const FlatAST &AST;
+  ASTContext &C;
+
+public:
+  DeclExpander(const FlatAST &AST, ASTContext &C) : AST(AST), C(C) {}
+
+  Decl *expandDecl(uint32_t I);
+  Stmt *expandStmt(uint32_t I);
+  Expr *expandExpr(uint32_t I);
+};
+} // namespace
+
+Decl *DeclExpander::expandDecl(uint32_t I) {
+  const FlatAST::Node &N = AST.getNode(I);
+  if (N.Kind == FlatAST::NK_Function) {
+    SmallVector<ParamDecl *, 8> Params;
+    for (uint32_t PI : AST.getParams(N)) {
+      const FlatAST::Node &P = AST.getNode(PI);
+      Params.push_back(new (C) ParamDecl(AST.getLocation(PI), AST.getName(P),
+                                         AST.getType(P)));
+    }
+    SmallVector<Stmt *, 16> Body;
+    for (uint32_t SI : AST.getChildList(AST.getNode(AST.getBody(N))))
+      Body.push_back(expandStmt(SI));
+    return FunctionDecl::Create(C, AST.getLocation(I), AST.getName(N),
+                                AST.getType(N), Params, Body);
+  }
+
+  assert(N.Kind == FlatAST::NK_Var && "not a declaration");
+  Expr *Init = N.B == FlatAST::NoNode ? nullptr : expandExpr(N.B);
+  return new (C)
+      VarDecl(AST.getLocation(I), AST.getName(N), AST.getType(N), Init);
+}
+
+Stmt *DeclExpander::expandStmt(uint32_t I) {
+  const FlatAST::Node &N = AST.getNode(I);
+  switch (N.Kind) {
+  case FlatAST::NK_ExprStmt:
+    return new (C) ExprStmt(expandExpr(N.A));
+  case FlatAST::NK_ReturnStmt:
+    return new (C)
+        ReturnStmt(N.A == FlatAST::NoNode ? nullptr : expandExpr(N.A));
+  case FlatAST::NK_IfStmt:
+    return new (C)
+        IfStmt(expandExpr(N.A), expandStmt(N.B),
+               N.C == FlatAST::NoNode ? nullptr : expandStmt(N.C));
+  case FlatAST::NK_CompoundStmt: {
+    SmallVector<Stmt *, 16> Body;
+    for (uint32_t SI : AST.getChildList(N))
+      Body.push_back(expandStmt(SI));
+    return CompoundStmt::Create(C, Body);
+  }
+  default:
+    llvm_unreachable("not a statement");
+  }
+}
+
+Expr *DeclExpander::expandExpr(uint32_t I) {
+  const FlatAST::Node &N = AST.getNode(I);
+  SMLoc Loc = AST.getLocation(I);
+  switch (N.Kind) {
+  case FlatAST::NK_IntegerLiteral:
+    return new (C) IntegerLiteral(Loc, AST.getIntValue(N));
+  case FlatAST::NK_FloatLiteral:
+    return new (C) FloatLiteral(Loc, AST.getFloatValue(N));
+  case FlatAST::NK_VarRef:
+    return new (C) VarRefExpr(Loc, AST.getName(N));
+  case FlatAST::NK_Binary:
+    return new (C) BinaryExpr(Loc, BinaryExpr::BinaryOpKind(N.Op),
+                              expandExpr(N.A), expandExpr(N.B));
+  case FlatAST::NK_Unary:
+    return new (C)
+        UnaryExpr(Loc, UnaryExpr::UnaryOpKind(N.Op), expandExpr(N.A));
+  case FlatAST::NK_Call: {
+    SmallVector<Expr *, 8> Args;
+    for (uint32_t AI : AST.getChildList(N))
+      Args.push_back(expandExpr(AI));
+    return CallExpr::Create(C, Loc, AST.getName(N), Args);
+  }
+  default:
+    llvm_unreachable("not an expression");
+  }
+}
+
+DeclList FlatAST::toDecls(ASTContext &C) const {
+  DeclExpander Expander(*this, C);
+  DeclList Decls;
+  Decls.reserve(TopLevel.size());
+  for (uint32_t I : TopLevel)
+    Decls.push_back(Expander.expandDecl(I));
+  return Decls;
+}
+
+FlatAST FlatAST::build(ArrayRef<Decl *> Decls) {
+  FlatAST AST;
+  FlatASTBuilder(AST).build(Decls);
+  return AST;
+}
+
+size_t FlatAST::getMemorySize() const {
+  return Nodes.capacity() * sizeof(Node) + Locs.capacity() * sizeof(SMLoc) +
+         Lists.capacity() * sizeof(uint32_t) +
+         TopLevel.capacity() * sizeof(uint32_t) +
+         Names.capacity() * sizeof(IdentifierInfo *) +
+         Types.capacity() * sizeof(StringRef) +
+         Ints.capacity() * sizeof(llvm::APSInt) +
+         Floats.capacity() * sizeof(llvm::APFloat);
+}
@@ -3,37 +3,88 @@
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/Function.h>
+#include <llvm/IR/PassInstrumentation.h>
+#include <llvm/IR/PassTimingInfo.h>
 #include <llvm/IR/Type.h>
 #include <llvm/IR/Verifier.h>
+#include <llvm/Passes/PassBuilder.h>
 #include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/Utils/Mem2Reg.h>
 
 using namespace tinycc;
 
 CodeGenerator::CodeGenerator(DiagnosticsEngine &Diags, StringRef ModuleName)
-    : Diags(Diags), CurFunction(nullptr) {
+    : Diags(&Diags), CurFunction(nullptr) {
   Context = std::make_unique<llvm::LLVMContext>();
   TheModule = std::make_unique<llvm::Module>(ModuleName.str(), *Context);
   Builder = std::make_unique<llvm::IRBuilder<>>(*Context);
 }
 
-bool CodeGenerator::generateCode(
-    const std::vector<std::unique_ptr<Decl>> &Decls) {
+bool CodeGenerator::generateCode(ArrayRef<Decl *> Decls) {
+  return generateDecls(Decls, 0, Decls.size());
+}
+
+bool CodeGenerator::generateDecls(ArrayRef<Decl *> Decls, size_t Begin,
+                                  size_t End) {
   bool Success = true;
 
   // Generate code for all top-level declarations
-  for (const auto &D : Decls) {
-    if (auto *FD = llvm::dyn_cast<FunctionDecl>(D.get())) {
-      if (!generateFunctionDecl(FD))
+  for (size_t I = 0, E = Decls.size(); I != E; ++I) {
+    bool Define = I >= Begin && I < End;
+    if (auto *FD = llvm::dyn_cast<FunctionDecl>(Decls[I])) {
+      if (!generateFunctionDecl(FD, Define))
         Success = false;
-    } else if (auto *VD = llvm::dyn_cast<VarDecl>(D.get())) {
-      if (!generateVarDecl(VD))
+    } else if (auto *VD = llvm::dyn_cast<VarDecl>(Decls[I])) {
+      if (!generateVarDecl(VD, Define))
         Success = false;
     }
+    // Generation goes on after an error reported to a deferring engine
+    if (Diags->getFirstDeferred())
+      return false;
   }
 
   return Success;
 }
 
+void CodeGenerator::optimize(unsigned OptLevel) {
+  static const llvm::OptimizationLevel Levels[] = {
+      llvm::OptimizationLevel::O0, llvm::OptimizationLevel::O1,
+      llvm::OptimizationLevel::O2, llvm::OptimizationLevel::O3};
+  assert(OptLevel < 4 && "invalid optimization level");
+
+  // Timings are collected only if -time-passes was given
+  llvm::PassInstrumentationCallbacks PIC;
+  llvm::TimePassesHandler TimePasses;
+  TimePasses.registerCallbacks(PIC);
+
+  // The analysis managers must be declared in this order so that they are
+  // destroyed inner to outer
+  llvm::LoopAnalysisManager LAM;
+  llvm::FunctionAnalysisManager FAM;
+  llvm::CGSCCAnalysisManager CGAM;
+  llvm::ModuleAnalysisManager MAM;
+
+  llvm::PassBuilder PB(TM, llvm::PipelineTuningOptions(), /*PGOOpt=*/{}, &PIC);
+  PB.registerModuleAnalyses(MAM);
+  PB.registerCGSCCAnalyses(CGAM);
+  PB.registerFunctionAnalyses(FAM);
+  PB.registerLoopAnalyses(LAM);
+  PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+  llvm::OptimizationLevel Level = Levels[OptLevel];
+  llvm::ModulePassManager MPM;
+  if (OptLevel == 0) {
+    // Even at -O0, promote locals to SSA values rather than loading and
+    // storing them on every use. The other pipelines start with SROA, which
+    // does the same.
+    MPM = PB.buildO0DefaultPipeline(Level);
+    MPM.addPass(llvm::createModuleToFunctionPassAdaptor(llvm::PromotePass()));
+  } else {
+    MPM = PB.buildPerModuleDefaultPipeline(Level);
+  }
+  MPM.run(*TheModule, MAM);
+}
+
 void CodeGenerator::print(llvm::raw_ostream &OS) {
   TheModule->print(OS, nullptr);
 }
@@ -48,10 +99,20 @@ llvm::Type *CodeGenerator::getLLVMType(StringRef TypeName) {
   }
 
   // Report unknown type and default to int
-  Diags.report(SMLoc(), diag::unknown_type, TypeName);
+  Diags->report(SMLoc(), diag::unknown_type, TypeName);
   return llvm::Type::getInt32Ty(*Context);
 }
 
+// Convert an int or float value to Ty as C does on assignment, truncating
+// floats toward zero
+llvm::Value *CodeGenerator::convertToType(llvm::Value *V, llvm::Type *Ty) {
+  if (V->getType()->isIntegerTy() && Ty->isFloatTy())
+    return Builder->CreateSIToFP(V, Ty);
+  if (V->getType()->isFloatTy() && Ty->isIntegerTy())
+    return Builder->CreateFPToSI(V, Ty);
+  return V;
+}
+
 llvm::FunctionType *CodeGenerator::getFunctionType(FunctionDecl *FD) {
   llvm::Type *RetType = getLLVMType(FD->getReturnType());
 
@@ -63,19 +124,24 @@ llvm::FunctionType *CodeGenerator::getFunctionType(FunctionDecl *FD) {
   return llvm::FunctionType::get(RetType, ParamTypes, false);
 }
 
-llvm::Function *CodeGenerator::generateFunctionDecl(FunctionDecl *FD) {
+llvm::Function *CodeGenerator::generateFunctionDecl(FunctionDecl *FD,
+                                                    bool Define) {
   llvm::FunctionType *FT = getFunctionType(FD);
   llvm::Function *F = llvm::Function::Create(
       FT, llvm::Function::ExternalLinkage, FD->getName(), TheModule.get());
 
+  // The first declaration of a name is the one calls resolve to
+  Functions.try_emplace(FD->getIdentifier(), F);
+
   // Set parameter names
   unsigned Idx = 0;
   for (auto &Arg : F->args()) {
     Arg.setName(FD->getParams()[Idx++]->getName());
   }
 
-  // If this is just a declaration without a body, return the function
-  if (FD->getBody().empty())
+  // If this is just a declaration without a body, or one defined by another
+  // generator, return the function
+  if (!Define || FD->getBody().empty())
     return F;
 
   // Create a basic block for the function body
@@ -86,17 +152,28 @@ llvm::Function *CodeGenerator::generateFunctionDecl(FunctionDecl *FD) {
   llvm::Function *OldCurFunction = CurFunction;
   CurFunction = F;
 
+  // Every alloca of the function goes before this placeholder, at the top of
+  // the entry block, wherever the variable is declared. mem2reg only promotes
+  // allocas in the entry block, and others would adjust the stack at run time.
+  llvm::Type *Int32Ty = llvm::Type::getInt32Ty(*Context);
+  AllocaInsertPt = new llvm::BitCastInst(llvm::UndefValue::get(Int32Ty),
+                                         Int32Ty, "allocapt", BB);
+
   // Clear the variable symbol table
   NamedValues.clear();
 
-  // Add parameters to the symbol table
+  // Add parameters to the symbol table. Each one is copied to a stack slot
+  // so that it can be assigned to like any other variable.
   for (auto &Arg : F->args()) {
-    NamedValues[Arg.getName().str()] = &Arg;
+    llvm::AllocaInst *Alloca =
+        createEntryBlockAlloca(Arg.getType(), Arg.getName() + ".addr");
+    Builder->CreateStore(&Arg, Alloca);
+    NamedValues[FD->getParams()[Arg.getArgNo()]->getIdentifier()] = Alloca;
   }
 
   // Generate code for the function body
   for (Stmt *S : FD->getBody()) {
-    generateStmt(S);
+    visit(S);
   }
 
   // Add a return statement if the function doesn't have one
@@ -109,9 +186,18 @@ llvm::Function *CodeGenerator::generateFunctionDecl(FunctionDecl *FD) {
     }
   }
 
-  // Verify the function
-  if (llvm::verifyFunction(*F, &llvm::errs())) {
-    Diags.report(FD->getLocation(), diag::invalid_function, FD->getName());
+  AllocaInsertPt->eraseFromParent();
+  AllocaInsertPt = nullptr;
+
+  // Verify the function. The verifier's findings go into the diagnostic
+  // rather than straight to errs(), which shards generating in parallel share.
+  std::string VerifierErrors;
+  llvm::raw_string_ostream VerifierOS(VerifierErrors);
+  if (llvm::verifyFunction(*F, &VerifierOS)) {
+    Diags->report(FD->getLocation(), diag::invalid_function, FD->getName(),
+                  StringRef(VerifierOS.str()).rtrim());
+    if (Functions.lookup(FD->getIdentifier()) == F)
+      Functions.erase(FD->getIdentifier());
     F->eraseFromParent();
     return nullptr;
   }
@@ -122,77 +208,97 @@ llvm::Function *CodeGenerator::generateFunctionDecl(FunctionDecl *FD) {
   return F;
 }
 
-llvm::Value *CodeGenerator::generateVarDecl(VarDecl *VD) {
+llvm::Value *CodeGenerator::generateVarDecl(VarDecl *VD, bool Define) {
   llvm::Type *VarType = getLLVMType(VD->getType());
 
+  // Global variable defined by another generator
+  if (!CurFunction && !Define)
+    return new llvm::GlobalVariable(*TheModule, VarType, false,
+                                    llvm::GlobalValue::ExternalLinkage,
+                                    nullptr, VD->getName());
+
   // Global variable
   if (!CurFunction) {
     llvm::GlobalVariable *GV = new llvm::GlobalVariable(
         *TheModule, VarType, false, llvm::GlobalValue::ExternalLinkage,
         llvm::Constant::getNullValue(VarType), VD->getName());
 
-    // Initialize if there's an initializer
-    if (VD->getInit()) {
-      if (auto *FL = llvm::dyn_cast<FloatLiteral>(VD->getInit())) {
-        GV->setInitializer(
-            llvm::ConstantFP::get(VarType, FL->getValue().convertToFloat()));
-      } else if (auto *IL = llvm::dyn_cast<IntegerLiteral>(VD->getInit())) {
-        GV->setInitializer(
-            llvm::ConstantInt::get(VarType, IL->getValue().getZExtValue()));
+    // Initialize if there's an initializer. Constant expressions have been
+    // folded to a literal by now; the value is converted to the variable's
+    // type as an assignment would.
+    if (Expr *Init = VD->getInit()) {
+      llvm::Constant *InitVal = nullptr;
+      if (auto *FL = llvm::dyn_cast<FloatLiteral>(Init)) {
+        if (VarType->isFloatTy()) {
+          InitVal = llvm::ConstantFP::get(VarType,
+                                          FL->getValue().convertToFloat());
+        } else {
+          // Float to int conversion truncates toward zero
+          llvm::APSInt Value(32, /*isUnsigned=*/false);
+          bool IsExact;
+          FL->getValue().convertToInteger(Value, llvm::APFloat::rmTowardZero,
+                                          &IsExact);
+          InitVal = llvm::ConstantInt::get(VarType, Value.getZExtValue());
+        }
+      } else if (auto *IL = llvm::dyn_cast<IntegerLiteral>(Init)) {
+        if (VarType->isFloatTy()) {
+          llvm::APFloat Value(llvm::APFloat::IEEEsingle());
+          Value.convertFromAPInt(IL->getValue(), /*IsSigned=*/true,
+                                 llvm::APFloat::rmNearestTiesToEven);
+          InitVal = llvm::ConstantFP::get(*Context, Value);
+        } else {
+          InitVal =
+              llvm::ConstantInt::get(VarType, IL->getValue().getZExtValue());
+        }
       }
+
+      if (!InitVal) {
+        Diags->report(VD->getLocation(), diag::err_init_not_constant,
+                     VD->getName());
+        return nullptr;
+      }
+      GV->setInitializer(InitVal);
     }
 
     return GV;
   }
 
   // Local variable
-  llvm::AllocaInst *Alloca =
-      Builder->CreateAlloca(VarType, nullptr, VD->getName());
-  NamedValues[VD->getName().str()] = Alloca;
+  llvm::AllocaInst *Alloca = createEntryBlockAlloca(VarType, VD->getName());
+  NamedValues[VD->getIdentifier()] = Alloca;
 
   // Initialize if there's an initializer
   if (VD->getInit()) {
-    llvm::Value *InitVal = generateExpr(VD->getInit());
+    llvm::Value *InitVal = visit(VD->getInit());
     if (!InitVal)
       return nullptr;
-    Builder->CreateStore(InitVal, Alloca);
+    Builder->CreateStore(convertToType(InitVal, VarType), Alloca);
   }
 
   return Alloca;
 }
 
-void CodeGenerator::generateStmt(Stmt *S) {
-  switch (S->getKind()) {
-  case Stmt::SK_Return:
-    generateReturnStmt(llvm::cast<ReturnStmt>(S));
-    break;
-  case Stmt::SK_If:
-    generateIfStmt(llvm::cast<IfStmt>(S));
-    break;
-  case Stmt::SK_Compound:
-    generateCompoundStmt(llvm::cast<CompoundStmt>(S));
-    break;
-  case Stmt::SK_Expr:
-    generateExprStmt(llvm::cast<ExprStmt>(S));
-    break;
-  }
+llvm::AllocaInst *CodeGenerator::createEntryBlockAlloca(llvm::Type *Ty,
+                                                       const llvm::Twine &Name) {
+  llvm::IRBuilder<> AllocaBuilder(AllocaInsertPt);
+  return AllocaBuilder.CreateAlloca(Ty, nullptr, Name);
 }
 
-void CodeGenerator::generateReturnStmt(ReturnStmt *RS) {
+void CodeGenerator::visitReturnStmt(ReturnStmt *RS) {
   if (!RS->getRetVal()) {
     Builder->CreateRetVoid();
     return;
   }
 
-  llvm::Value *RetVal = generateExpr(RS->getRetVal());
+  llvm::Value *RetVal = visit(RS->getRetVal());
   if (!RetVal)
     return;
 
-  Builder->CreateRet(RetVal);
+  Builder->CreateRet(convertToType(RetVal, CurFunction->getReturnType()));
 }
 
-void CodeGenerator::generateIfStmt(IfStmt *IS) {
-  llvm::Value *CondV = generateExpr(IS->getCond());
+void CodeGenerator::visitIfStmt(IfStmt *IS) {
+  llvm::Value *CondV = visit(IS->getCond());
   if (!CondV)
     return;
 
@@ -215,7 +321,7 @@ void CodeGenerator::generateIfStmt(IfStmt *IS) {
 
   // Emit then block
   Builder->SetInsertPoint(ThenBB);
-  generateStmt(IS->getThen());
+  visit(IS->getThen());
 
   // Check if the 'then' block already has a terminator (like a return)
   bool ThenHasTerminator =
@@ -229,7 +335,7 @@ void CodeGenerator::generateIfStmt(IfStmt *IS) {
     // Add the else block to the function
     TheFunction->insert(TheFunction->end(), ElseBB);
     Builder->SetInsertPoint(ElseBB);
-    generateStmt(IS->getElse());
+    visit(IS->getElse());
 
     // Check if the 'else' block already has a terminator
     ElseHasTerminator = Builder->GetInsertBlock()->getTerminator() != nullptr;
@@ -237,8 +343,9 @@ void CodeGenerator::generateIfStmt(IfStmt *IS) {
       Builder->CreateBr(MergeBB);
   }
 
-  // Only add the merge block if it's reachable
-  if (!ThenHasTerminator || (ElseBB && !ElseHasTerminator)) {
+  // Only add the merge block if it's reachable. Without an else, the
+  // condition branches to it directly.
+  if (!ThenHasTerminator || !ElseBB || !ElseHasTerminator) {
     TheFunction->insert(TheFunction->end(), MergeBB);
     Builder->SetInsertPoint(MergeBB);
   } else {
@@ -248,24 +355,24 @@ void CodeGenerator::generateIfStmt(IfStmt *IS) {
   }
 }
 
-void CodeGenerator::generateCompoundStmt(CompoundStmt *CS) {
+void CodeGenerator::visitCompoundStmt(CompoundStmt *CS) {
   for (Stmt *S : CS->getBody()) {
-    generateStmt(S);
+    visit(S);
   }
 }
 
-void CodeGenerator::generateExprStmt(ExprStmt *ES) {
+void CodeGenerator::visitExprStmt(ExprStmt *ES) {
   // Check if this is a variable reference that might be from a variable
   // declaration
   if (auto *VR = llvm::dyn_cast<VarRefExpr>(ES->getExpr())) {
     // If the variable is not in the symbol table, it might be a new declaration
-    if (!NamedValues.count(VR->getName().str())) {
+    if (!NamedValues.count(VR->getIdentifier())) {
       // Create a new local variable
-      llvm::AllocaInst *Alloca = Builder->CreateAlloca(
-          llvm::Type::getInt32Ty(*Context), nullptr, VR->getName());
+      llvm::AllocaInst *Alloca = createEntryBlockAlloca(
+          llvm::Type::getInt32Ty(*Context), VR->getName());
 
       // Add to symbol table
-      NamedValues[VR->getName().str()] = Alloca;
+      NamedValues[VR->getIdentifier()] = Alloca;
 
       // No need to generate any other code for the declaration
       return;
@@ -273,42 +380,23 @@ void CodeGenerator::generateExprStmt(ExprStmt *ES) {
   }
 
   // For regular expressions, generate the code
-  generateExpr(ES->getExpr());
-}
-
-llvm::Value *CodeGenerator::generateExpr(Expr *E) {
-  switch (E->getKind()) {
-  case Expr::EK_IntegerLiteral:
-    return generateIntegerLiteral(llvm::cast<IntegerLiteral>(E));
-  case Expr::EK_FloatLiteral:
-    return generateFloatLiteral(llvm::cast<FloatLiteral>(E));
-  case Expr::EK_VarRef:
-    return generateVarRefExpr(llvm::cast<VarRefExpr>(E));
-  case Expr::EK_Binary:
-    return generateBinaryExpr(llvm::cast<BinaryExpr>(E));
-  case Expr::EK_Unary:
-    return generateUnaryExpr(llvm::cast<UnaryExpr>(E));
-  case Expr::EK_Call:
-    return generateCallExpr(llvm::cast<CallExpr>(E));
-  }
-
-  return nullptr;
+  visit(ES->getExpr());
 }
 
-llvm::Value *CodeGenerator::generateIntegerLiteral(IntegerLiteral *IL) {
+llvm::Value *CodeGenerator::visitIntegerLiteral(IntegerLiteral *IL) {
   return llvm::ConstantInt::get(llvm::Type::getInt32Ty(*Context),
                                 IL->getValue().getZExtValue());
 }
 
-llvm::Value *CodeGenerator::generateFloatLiteral(FloatLiteral *FL) {
+llvm::Value *CodeGenerator::visitFloatLiteral(FloatLiteral *FL) {
   return llvm::ConstantFP::get(llvm::Type::getFloatTy(*Context),
                                FL->getValue().convertToFloat());
 }
 
-llvm::Value *CodeGenerator::generateVarRefExpr(VarRefExpr *VR) {
-  llvm::Value *V = NamedValues[VR->getName().str()];
+llvm::Value *CodeGenerator::visitVarRefExpr(VarRefExpr *VR) {
+  llvm::Value *V = NamedValues.lookup(VR->getIdentifier());
   if (!V) {
-    Diags.report(VR->getLocation(), diag::unknown_identifier, VR->getName());
+    Diags->report(VR->getLocation(), diag::unknown_identifier, VR->getName());
     return nullptr;
   }
 
@@ -320,40 +408,43 @@ llvm::Value *CodeGenerator::generateVarRefExpr(VarRefExpr *VR) {
   return V;
 }
 
-llvm::Value *CodeGenerator::generateBinaryExpr(BinaryExpr *BE) {
+llvm::Value *CodeGenerator::visitBinaryExpr(BinaryExpr *BE) {
   // Special case for assignment
   if (BE->getOpcode() == BinaryExpr::BO_Eq) {
     // The left side must be a variable reference
     auto *LHS = llvm::dyn_cast<VarRefExpr>(BE->getLeft());
     if (!LHS) {
-      Diags.report(BE->getLocation(), diag::err_expected, "lvalue",
+      Diags->report(BE->getLocation(), diag::err_expected, "lvalue",
                    "expression");
       return nullptr;
     }
 
     // Generate code for the right hand side
-    llvm::Value *RHS = generateExpr(BE->getRight());
+    llvm::Value *RHS = visit(BE->getRight());
     if (!RHS)
       return nullptr;
 
     // Look up the variable
-    llvm::Value *Variable = NamedValues[LHS->getName().str()];
+    llvm::Value *Variable = NamedValues.lookup(LHS->getIdentifier());
     if (!Variable) {
-      Diags.report(LHS->getLocation(), diag::unknown_identifier,
+      Diags->report(LHS->getLocation(), diag::unknown_identifier,
                    LHS->getName());
       return nullptr;
     }
 
-    // Store the value
-    Builder->CreateStore(RHS, Variable);
+    // Store the value, converted to the variable's type. Every variable has a
+    // stack slot, so the slot's type is the variable's.
+    auto *Slot = llvm::cast<llvm::AllocaInst>(Variable);
+    RHS = convertToType(RHS, Slot->getAllocatedType());
+    Builder->CreateStore(RHS, Slot);
 
     // Return the value we just stored
     return RHS;
   }
 
   // Normal binary expression
-  llvm::Value *L = generateExpr(BE->getLeft());
-  llvm::Value *R = generateExpr(BE->getRight());
+  llvm::Value *L = visit(BE->getLeft());
+  llvm::Value *R = visit(BE->getRight());
 
   if (!L || !R)
     return nullptr;
@@ -410,8 +501,8 @@ llvm::Value *CodeGenerator::generateBinaryExpr(BinaryExpr *BE) {
   return nullptr;
 }
 
-llvm::Value *CodeGenerator::generateUnaryExpr(UnaryExpr *UE) {
-  llvm::Value *SubV = generateExpr(UE->getSubExpr());
+llvm::Value *CodeGenerator::visitUnaryExpr(UnaryExpr *UE) {
+  llvm::Value *SubV = visit(UE->getSubExpr());
   if (!SubV)
     return nullptr;
 
@@ -441,17 +532,17 @@ llvm::Value *CodeGenerator::generateUnaryExpr(UnaryExpr *UE) {
   return nullptr;
 }
 
-llvm::Value *CodeGenerator::generateCallExpr(CallExpr *CE) {
+llvm::Value *CodeGenerator::visitCallExpr(CallExpr *CE) {
   // Look up the function in the module
-  llvm::Function *CalleeF = TheModule->getFunction(CE->getCallee());
+  llvm::Function *CalleeF = Functions.lookup(CE->getCalleeIdentifier());
   if (!CalleeF) {
-    Diags.report(CE->getLocation(), diag::unknown_identifier, CE->getCallee());
+    Diags->report(CE->getLocation(), diag::unknown_identifier, CE->getCallee());
     return nullptr;
   }
 
   // Check argument count
   if (CalleeF->arg_size() != CE->getArgs().size()) {
-    Diags.report(CE->getLocation(), diag::err_argument_count_mismatch,
+    Diags->report(CE->getLocation(), diag::err_argument_count_mismatch,
                  CE->getCallee(), CalleeF->arg_size(), CE->getArgs().size());
     return nullptr;
   }
@@ -459,10 +550,11 @@ llvm::Value *CodeGenerator::generateCallExpr(CallExpr *CE) {
   // Generate code for arguments
   std::vector<llvm::Value *> ArgsV;
   for (auto *Arg : CE->getArgs()) {
-    llvm::Value *ArgV = generateExpr(Arg);
+    llvm::Value *ArgV = visit(Arg);
     if (!ArgV)
       return nullptr;
-    ArgsV.push_back(ArgV);
+    ArgsV.push_back(
+        convertToType(ArgV, CalleeF->getArg(ArgsV.size())->getType()));
   }
 
   return Builder->CreateCall(CalleeF, ArgsV);
@@ -0,0 +1,94 @@
+#include "CodeGen/CodeGen.h"
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Support/CodeGen.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Target/TargetOptions.h>
+#if LLVM_VERSION_MAJOR >= 17
+#include <llvm/TargetParser/Host.h>
+#else
+#include <llvm/Support/Host.h>
+#endif
+#include <mutex>
+
+using namespace tinycc;
+
+std::unique_ptr<llvm::TargetMachine>
+tinycc::createTargetMachine(StringRef Triple, unsigned OptLevel,
+                            std::string &Error) {
+  // Register every target LLVM was built with, so that any triple it
+  // supports can be given
+  static std::once_flag TargetsInitialized;
+  std::call_once(TargetsInitialized, [] {
+    llvm::InitializeAllTargetInfos();
+    llvm::InitializeAllTargets();
+    llvm::InitializeAllTargetMCs();
+    llvm::InitializeAllAsmPrinters();
+  });
+
+  std::string TripleStr = Triple.empty() ? llvm::sys::getDefaultTargetTriple()
+                                         : llvm::Triple::normalize(Triple);
+  const llvm::Target *T = llvm::TargetRegistry::lookupTarget(TripleStr, Error);
+  if (!T)
+    return nullptr;
+
+  // Tune for the host CPU when compiling for the host, and for the target's
+  // default CPU otherwise
+  std::string CPU = Triple.empty() ? llvm::sys::getHostCPUName().str() : "";
+
+#if LLVM_VERSION_MAJOR >= 18
+  static const llvm::CodeGenOptLevel Levels[] = {
+      llvm::CodeGenOptLevel::None, llvm::CodeGenOptLevel::Less,
+      llvm::CodeGenOptLevel::Default, llvm::CodeGenOptLevel::Aggressive};
+#else
+  static const llvm::CodeGenOpt::Level Levels[] = {
+      llvm::CodeGenOpt::None, llvm::CodeGenOpt::Less, llvm::CodeGenOpt::Default,
+      llvm::CodeGenOpt::Aggressive};
+#endif
+  assert(OptLevel < 4 && "invalid optimization level");
+
+  llvm::TargetOptions Options;
+  return std::unique_ptr<llvm::TargetMachine>(T->createTargetMachine(
+      TripleStr, CPU, /*Features=*/"", Options, llvm::Reloc::PIC_,
+      /*CM=*/{}, Levels[OptLevel]));
+}
+
+void CodeGenerator::setTargetMachine(llvm::TargetMachine *Target) {
+  TM = Target;
+  TheModule->setTargetTriple(TM->getTargetTriple().str());
+  TheModule->setDataLayout(TM->createDataLayout());
+}
+
+bool CodeGenerator::emit(llvm::raw_pwrite_stream &OS, EmitKind Kind) {
+  switch (Kind) {
+  case EmitKind::LLVMIR:
+    print(OS);
+    return true;
+  case EmitKind::Bitcode:
+    llvm::WriteBitcodeToFile(*TheModule, OS);
+    return true;
+  case EmitKind::Assembly:
+  case EmitKind::Object:
+    break;
+  }
+
+  assert(TM && "assembly and object output need a target machine");
+#if LLVM_VERSION_MAJOR >= 18
+  llvm::CodeGenFileType FileType = Kind == EmitKind::Assembly
+                                       ? llvm::CodeGenFileType::AssemblyFile
+                                       : llvm::CodeGenFileType::ObjectFile;
+#else
+  llvm::CodeGenFileType FileType = Kind == EmitKind::Assembly
+                                       ? llvm::CGFT_AssemblyFile
+                                       : llvm::CGFT_ObjectFile;
+#endif
+
+  // Machine code generation still runs on the legacy pass manager
+  llvm::legacy::PassManager PM;
+  if (TM->addPassesToEmitFile(PM, OS, /*DwoOut=*/nullptr, FileType))
+    return false;
+  PM.run(*TheModule);
+  return true;
+}
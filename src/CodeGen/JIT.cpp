@@ -0,0 +1,148 @@
+#include "CodeGen/CodeGen.h"
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/ExecutionEngine/Orc/CompileUtils.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/TargetProcess/TargetExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/SHA1.h>
+#include <llvm/Support/TargetSelect.h>
+
+using namespace tinycc;
+
+namespace {
+
+// Keeps the objects the JIT compiles in a directory, named after the module
+// they came from. runMain() names modules after a hash of their contents, so
+// running an unchanged program again loads its object instead of generating
+// machine code. The cache is only an optimization: failing to read or write
+// it is not an error.
+class ObjectFileCache : public llvm::ObjectCache {
+  std::string Dir;
+
+  llvm::SmallString<128> getPath(const llvm::Module *M) const {
+    llvm::SmallString<128> Path(Dir);
+    llvm::sys::path::append(Path, M->getModuleIdentifier() + ".o");
+    return Path;
+  }
+
+public:
+  explicit ObjectFileCache(StringRef Dir) : Dir(Dir.str()) {}
+
+  void notifyObjectCompiled(const llvm::Module *M,
+                            llvm::MemoryBufferRef Obj) override {
+    if (llvm::sys::fs::create_directories(Dir))
+      return;
+
+    // Write to a temporary file first so that a concurrent run never reads a
+    // partial object
+    llvm::SmallString<128> Path = getPath(M), TempPath;
+    int FD;
+    if (llvm::sys::fs::createUniqueFile(llvm::Twine(Path) + ".tmp%%%%%%", FD,
+                                        TempPath))
+      return;
+    {
+      llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+      OS << Obj.getBuffer();
+      if (OS.has_error()) {
+        OS.clear_error();
+        llvm::sys::fs::remove(TempPath);
+        return;
+      }
+    }
+    if (llvm::sys::fs::rename(TempPath, Path))
+      llvm::sys::fs::remove(TempPath);
+  }
+
+  std::unique_ptr<llvm::MemoryBuffer>
+  getObject(const llvm::Module *M) override {
+    auto Buffer = llvm::MemoryBuffer::getFile(getPath(M), /*IsText=*/false,
+                                              /*RequiresNullTerminator=*/false);
+    if (!Buffer)
+      return nullptr;
+    return std::move(*Buffer);
+  }
+};
+
+// A name for the module that changes whenever its contents do
+std::string hashModule(const llvm::Module &M) {
+  llvm::SmallVector<char, 0> Bitcode;
+  llvm::raw_svector_ostream OS(Bitcode);
+  llvm::WriteBitcodeToFile(M, OS);
+  return llvm::toHex(llvm::SHA1::hash(llvm::arrayRefFromStringRef(
+      StringRef(Bitcode.data(), Bitcode.size()))));
+}
+
+} // namespace
+
+llvm::Expected<int> CodeGenerator::runMain(StringRef ProgramName,
+                                           ArrayRef<std::string> Args,
+                                           StringRef CacheDir) {
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+
+  auto JTMB = llvm::orc::JITTargetMachineBuilder::detectHost();
+  if (!JTMB)
+    return JTMB.takeError();
+  if (TM)
+    JTMB->setCodeGenOptLevel(TM->getOptLevel());
+
+  llvm::orc::LLJITBuilder JITBuilder;
+  JITBuilder.setJITTargetMachineBuilder(std::move(*JTMB));
+
+  std::shared_ptr<ObjectFileCache> Cache;
+  if (!CacheDir.empty()) {
+    Cache = std::make_shared<ObjectFileCache>(CacheDir);
+    TheModule->setModuleIdentifier(hashModule(*TheModule));
+    JITBuilder.setCompileFunctionCreator(
+        [Cache](llvm::orc::JITTargetMachineBuilder JTMB)
+            -> llvm::Expected<
+                std::unique_ptr<llvm::orc::IRCompileLayer::IRCompiler>> {
+          auto TM = JTMB.createTargetMachine();
+          if (!TM)
+            return TM.takeError();
+          return std::make_unique<llvm::orc::TMOwningSimpleCompiler>(
+              std::move(*TM), Cache.get());
+        });
+  }
+
+  auto J = JITBuilder.create();
+  if (!J)
+    return J.takeError();
+
+  // Calls to functions the program only declares, e.g. from libc, resolve to
+  // the ones in this process
+  auto Generator =
+      llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+          (*J)->getDataLayout().getGlobalPrefix());
+  if (!Generator)
+    return Generator.takeError();
+  (*J)->getMainJITDylib().addGenerator(std::move(*Generator));
+
+  if (llvm::Error Err = (*J)->addIRModule(llvm::orc::ThreadSafeModule(
+          std::move(TheModule), std::move(Context))))
+    return Err;
+
+  // Looking main up compiles the module. Errors from that can refer to
+  // symbols owned by the JIT, so they are turned into text before it goes.
+  auto MainSym = (*J)->lookup("main");
+  if (!MainSym)
+    return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                   llvm::toString(MainSym.takeError()));
+#if LLVM_VERSION_MAJOR >= 16
+  auto *Main = MainSym->toPtr<int (*)(int, char *[])>();
+#else
+  auto *Main = llvm::jitTargetAddressToFunction<int (*)(int, char *[])>(
+      MainSym->getAddress());
+#endif
+
+  return llvm::orc::runAsMain(Main, Args, ProgramName);
+}
@@ -0,0 +1,152 @@
+#include "CodeGen/CodeGen.h"
+#include "AST/RecursiveASTVisitor.h"
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Parallel.h>
+#include <llvm/Support/raw_ostream.h>
+#include <algorithm>
+
+using namespace tinycc;
+
+namespace {
+
+// Counts the nodes of a declaration, as an estimate of the work generating
+// code for it takes
+class NodeCounter : public RecursiveASTVisitor<NodeCounter> {
+public:
+  size_t Count = 0;
+
+  bool visitDecl(Decl *) {
+    ++Count;
+    return true;
+  }
+  bool visitStmt(Stmt *) {
+    ++Count;
+    return true;
+  }
+  bool visitExpr(Expr *) {
+    ++Count;
+    return true;
+  }
+};
+
+// A TargetMachine isn't safe to share between threads, so each worker gets
+// its own copy
+std::unique_ptr<llvm::TargetMachine>
+cloneTargetMachine(const llvm::TargetMachine &TM) {
+  return std::unique_ptr<llvm::TargetMachine>(
+      TM.getTarget().createTargetMachine(
+          TM.getTargetTriple().str(), TM.getTargetCPU(),
+          TM.getTargetFeatureString(), TM.Options, TM.getRelocationModel(),
+          TM.getCodeModel(), TM.getOptLevel()));
+}
+
+} // namespace
+
+bool CodeGenerator::generateCodeInParallel(ArrayRef<Decl *> Decls,
+                                           unsigned NumShards,
+                                           unsigned OptLevel) {
+  // Weigh every declaration. The walk also parses any lazy bodies, which the
+  // workers can't do concurrently.
+  std::vector<size_t> Weights;
+  Weights.reserve(Decls.size());
+  size_t TotalWeight = 0;
+  for (Decl *D : Decls) {
+    NodeCounter Counter;
+    Counter.traverseDecl(D);
+    Weights.push_back(Counter.Count);
+    TotalWeight += Counter.Count;
+  }
+
+  // Each shard reports to an engine of its own that keeps its first error, so
+  // that no worker exits while the others are still running and the error
+  // reported doesn't depend on thread timing
+  struct Shard {
+    size_t Begin, End;
+    std::unique_ptr<DiagnosticsEngine> Diags;
+    std::unique_ptr<llvm::TargetMachine> TM;
+    std::unique_ptr<CodeGenerator> Gen;
+    llvm::SmallVector<char, 0> Bitcode;
+    bool Success = true;
+
+    Shard(size_t Begin, size_t End, SourceMgr &SrcMgr)
+        : Begin(Begin), End(End),
+          Diags(std::make_unique<DiagnosticsEngine>(SrcMgr,
+                                                    /*Deferring=*/true)) {}
+  };
+
+  // Split the declarations into runs of adjacent ones of about equal weight
+  std::vector<Shard> Shards;
+  NumShards = std::max(1u, NumShards);
+  size_t WeightPerShard = TotalWeight / NumShards + 1;
+  size_t Begin = 0, Weight = 0;
+  for (size_t I = 0, E = Decls.size(); I != E; ++I) {
+    Weight += Weights[I];
+    if (Weight >= WeightPerShard && Shards.size() + 1 < NumShards) {
+      Shards.emplace_back(Begin, I + 1, Diags->getSourceMgr());
+      Begin = I + 1;
+      Weight = 0;
+    }
+  }
+  Shards.emplace_back(Begin, Decls.size(), Diags->getSourceMgr());
+
+  // The first shard is generated into this generator's module, and the others
+  // into their own
+  for (size_t I = 1, E = Shards.size(); I != E; ++I) {
+    Shards[I].Gen = std::make_unique<CodeGenerator>(
+        *Shards[I].Diags, TheModule->getModuleIdentifier());
+    if (TM) {
+      Shards[I].TM = cloneTargetMachine(*TM);
+      Shards[I].Gen->setTargetMachine(Shards[I].TM.get());
+    }
+  }
+
+  DiagnosticsEngine *WasDiags = Diags;
+  Diags = Shards[0].Diags.get();
+  llvm::parallelForEach(Shards, [&](Shard &S) {
+    CodeGenerator &Gen = S.Gen ? *S.Gen : *this;
+    S.Success = Gen.generateDecls(Decls, S.Begin, S.End);
+    if (!S.Success)
+      return;
+    Gen.optimize(OptLevel);
+    if (!S.Gen)
+      return;
+
+    // Modules can only be linked within one context, so the shard moves to
+    // this generator's as bitcode. Writing it is done here, in parallel.
+    llvm::raw_svector_ostream OS(S.Bitcode);
+    llvm::WriteBitcodeToFile(*S.Gen->TheModule, OS);
+    S.Gen.reset();
+  });
+  Diags = WasDiags;
+
+  // Shards are in source order, so report the first one's error
+  for (const Shard &S : Shards)
+    if (const auto &D = S.Diags->getFirstDeferred())
+      Diags->report(*D);
+
+  bool Success = true;
+  for (Shard &S : Shards) {
+    Success &= S.Success;
+    if (S.Bitcode.empty())
+      continue;
+
+    llvm::MemoryBufferRef Buffer(StringRef(S.Bitcode.data(), S.Bitcode.size()),
+                                 TheModule->getModuleIdentifier());
+    llvm::Expected<std::unique_ptr<llvm::Module>> M =
+        llvm::parseBitcodeFile(Buffer, *Context);
+    if (!M) {
+      llvm::errs() << "Could not read back code generation shard: "
+                   << llvm::toString(M.takeError()) << "\n";
+      return false;
+    }
+    if (llvm::Linker::linkModules(*TheModule, std::move(*M)))
+      return false;
+    S.Bitcode = {};
+  }
+
+  return Success;
+}
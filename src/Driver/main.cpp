@@ -1,10 +1,18 @@
 #include "Lexer/Lexer.h"
 #include "Parser/Parser.h"
+#include "Parser/IncrementalParser.h"
 #include "AST/AST.h"
+#include "AST/ASTFile.h"
+#include "AST/FlatAST.h"
 #include "CodeGen/CodeGen.h"
+#include "Sema/ConstantFolding.h"
+#include "Support/Trace.h"
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/raw_ostream.h>
 #include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Parallel.h>
+#include <algorithm>
+#include <optional>
 
 using namespace tinycc;
 using namespace llvm;
@@ -21,24 +29,425 @@ static cl::opt<bool> enableCodeGen("codegen", cl::desc("Enable code generation")
                                  cl::init(false),
                                  cl::value_desc("enable or not"));
 
-static cl::opt<std::string> outputFile("o", cl::desc("Output file"),
-                                      cl::init("output.ll"),
-                                      cl::value_desc("Output file path"));
+static cl::opt<bool> foldConstantExprs(
+    "fold-constants",
+    cl::desc("Fold constant expressions and drop identity operations before "
+             "code generation"),
+    cl::init(true), cl::value_desc("enable or not"));
+
+// LLVM's own -time-passes option reports the time spent in each pass of the
+// pipeline.
+static cl::opt<unsigned> optLevel(
+    "O",
+    cl::desc("Optimization level: -O0, -O1, -O2 or -O3 (default -O0)"),
+    cl::Prefix, cl::init(0), cl::value_desc("level"));
+
+static cl::opt<bool> useTokenStream(
+    "token-stream",
+    cl::desc("Lex the whole input into a token stream before parsing"),
+    cl::init(false), cl::value_desc("enable or not"));
+
+static cl::opt<bool> parallelLex(
+    "parallel-lex",
+    cl::desc("Lex chunks of the input concurrently (implies --token-stream)"),
+    cl::init(false), cl::value_desc("enable or not"));
+
+static cl::opt<unsigned> lexChunkSize(
+    "lex-chunk-size", cl::desc("Bytes per chunk for --parallel-lex"),
+    cl::init(1 << 20), cl::value_desc("bytes"));
+
+static cl::opt<bool> lazyBodies(
+    "lazy-bodies",
+    cl::desc("Skip function bodies while parsing and parse each one only when "
+             "code generation needs it (implies --token-stream)"),
+    cl::init(false), cl::value_desc("enable or not"));
+
+static cl::opt<bool> parallelParse(
+    "parallel-parse",
+    cl::desc("Parse function bodies concurrently (implies --token-stream)"),
+    cl::init(false), cl::value_desc("enable or not"));
+
+static cl::opt<bool> parallelCodeGen(
+    "parallel-codegen",
+    cl::desc("Generate and optimize code for runs of functions concurrently, "
+             "each in a module of its own, then link them"),
+    cl::init(false), cl::value_desc("enable or not"));
+
+static cl::opt<unsigned> numThreads(
+    "threads",
+    cl::desc("Threads for --parallel-lex, --parallel-parse and "
+             "--parallel-codegen (default: one per core)"),
+    cl::init(0), cl::value_desc("N"));
+
+static cl::opt<bool> dumpTokens("dump-tokens",
+                                cl::desc("Print the tokens after lexing"),
+                                cl::init(false),
+                                cl::value_desc("enable or not"));
+
+static cl::opt<std::string> traceCategories(
+    "trace",
+    cl::desc("Comma separated trace categories to enable: lexer, parser, all"),
+    cl::value_desc("categories"));
+
+static cl::opt<std::string> traceFile(
+    "trace-file", cl::desc("Write trace output here instead of stderr"),
+    cl::value_desc("file"));
+
+static cl::opt<std::string> emitAST(
+    "emit-ast", cl::desc("Write the parsed AST to this file for --load-ast"),
+    cl::value_desc("file"));
+
+static cl::opt<std::string> loadAST(
+    "load-ast",
+    cl::desc("Read the AST from a file written by --emit-ast instead of "
+             "lexing and parsing the input"),
+    cl::value_desc("file"));
+
+static cl::opt<EmitKind> emitKind(
+    "emit", cl::desc("Kind of output --codegen writes"),
+    cl::values(clEnumValN(EmitKind::LLVMIR, "ll", "LLVM IR (default)"),
+               clEnumValN(EmitKind::Bitcode, "bc", "LLVM bitcode"),
+               clEnumValN(EmitKind::Assembly, "asm", "Native assembly"),
+               clEnumValN(EmitKind::Object, "obj", "Native object file")),
+    cl::init(EmitKind::LLVMIR));
+
+static cl::opt<std::string> targetTriple(
+    "target",
+    cl::desc("Target triple to generate code for (default: the host). IR and "
+             "bitcode are target independent unless this is given"),
+    cl::value_desc("triple"));
+
+static cl::opt<bool> runProgram(
+    "run",
+    cl::desc("Compile the input with the JIT and run its main(), exiting with "
+             "the value it returns"),
+    cl::init(false), cl::value_desc("enable or not"));
+
+static cl::list<std::string> runArgs(
+    "run-arg", cl::desc("Argument to pass to the program run by --run"),
+    cl::value_desc("arg"));
+
+static cl::opt<std::string> jitCache(
+    "jit-cache",
+    cl::desc("Keep the objects --run compiles in this directory and reuse "
+             "them while the program is unchanged"),
+    cl::value_desc("dir"));
+
+static cl::list<std::string> edits(
+    "edit",
+    cl::desc("With --parse, parse the input incrementally and replace the "
+             "first OLD in the text with NEW, for each edit in turn, checking "
+             "the tokens and declarations against a full parse after each. "
+             "\\n in OLD or NEW stands for a newline"),
+    cl::value_desc("OLD=>NEW"));
+
+static cl::opt<unsigned> segmentSize(
+    "segment-size", cl::desc("Bytes per segment of the incremental parse"),
+    cl::init(IncrementalParser::DefaultSegmentSize), cl::value_desc("bytes"));
+
+static cl::opt<std::string> outputFile(
+    "o", cl::desc("Output file (default: output.ll, .bc, .s or .o)"),
+    cl::value_desc("Output file path"));
 
 static cl::opt<std::string> inputFile(cl::Positional, cl::desc("<Input file>"),
                                       cl::init("-"),
                                       cl::value_desc("Input file path"));
 
+static void printTokens(const TokenStream &Tokens, StringRef Buffer) {
+  for (size_t I = 0, E = Tokens.size(); I != E; ++I) {
+    Token Tok = Tokens[I];
+    outs() << Tok.getName() << " '" << Tok.getIdentifier(Buffer) << "'\n";
+  }
+}
+
+static int generateCode(ArrayRef<Decl *> decls, ASTContext &Ctx,
+                        DiagnosticsEngine &Diags) {
+  if (foldConstantExprs)
+    foldConstants(decls, Ctx);
+
+  // Native output needs a target; IR only gets one if asked for
+  CodeGenerator CodeGen(Diags);
+  std::unique_ptr<TargetMachine> TM;
+  bool isNative = runProgram || emitKind == EmitKind::Assembly ||
+                  emitKind == EmitKind::Object;
+  if (isNative || !targetTriple.empty()) {
+    std::string Error;
+    TM = createTargetMachine(targetTriple, optLevel, Error);
+    if (!TM) {
+      errs() << "Could not create target machine: " << Error << "\n";
+      return 1;
+    }
+    CodeGen.setTargetMachine(TM.get());
+  }
+
+  // Generate LLVM IR
+  bool generated;
+  if (parallelCodeGen) {
+    unsigned shards = parallel::strategy.compute_thread_count();
+    generated = CodeGen.generateCodeInParallel(decls, shards, optLevel);
+  } else {
+    generated = CodeGen.generateCode(decls);
+  }
+  if (!generated) {
+    errs() << "Code generation failed.\n";
+    return 1;
+  }
+  // The parallel generator optimizes each shard as it is generated
+  if (!parallelCodeGen)
+    CodeGen.optimize(optLevel);
+
+  if (runProgram) {
+    Expected<int> exitCode = CodeGen.runMain(inputFile, runArgs, jitCache);
+    if (!exitCode) {
+      errs() << "Could not run " << inputFile << ": "
+             << toString(exitCode.takeError()) << "\n";
+      return 1;
+    }
+    return *exitCode;
+  }
+
+  static const char *const defaultOutputs[] = {"output.ll", "output.bc",
+                                               "output.s", "output.o"};
+  static const char *const outputNames[] = {"LLVM IR", "LLVM bitcode",
+                                            "assembly", "object file"};
+  unsigned kind = static_cast<unsigned>(emitKind.getValue());
+  std::string path =
+      outputFile.empty() ? defaultOutputs[kind] : outputFile.getValue();
+
+  // Write the output file
+  std::error_code EC;
+  raw_fd_ostream OS(path, EC, sys::fs::OF_None);
+  if (EC) {
+    errs() << "Could not open output file: " << EC.message() << "\n";
+    return 1;
+  }
+
+  if (!CodeGen.emit(OS, emitKind)) {
+    errs() << "Target " << TM->getTargetTriple().str()
+           << " can't emit this kind of file\n";
+    return 1;
+  }
+  outs() << "Generated " << outputNames[kind] << " written to " << path
+         << "\n";
+  return 0;
+}
+
+// The tokens of a full lex and parse of a text, and its declarations as an
+// AST file, or its first error
+namespace {
+struct FullParse {
+  TokenStream Tokens;
+  std::string AST;
+  std::optional<IncrementalParser::ParseError> Error;
+};
+} // namespace
+
+static FullParse parseFully(SourceMgr &SrcMgr, IdentifierTable &Idents,
+                            StringRef Text) {
+  FullParse Result;
+  DiagnosticsEngine Diags(SrcMgr, /*Deferring=*/true);
+  Lexer Lex(SrcMgr, Diags, Idents, Text);
+  Lex.lexAll(Result.Tokens);
+  // parse() one declaration at a time, as the parser goes on after an error
+  // reported to a deferring engine
+  ASTContext Ctx;
+  DeclList Decls;
+  Parser P(Lex, Result.Tokens, Diags, Ctx);
+  while (!Diags.getFirstDeferred() && !P.atEOF())
+    if (Decl *D = P.parseNextTopLevelDecl())
+      Decls.push_back(D);
+  if (const auto &D = Diags.getFirstDeferred()) {
+    Result.Error = IncrementalParser::ParseError{
+        uint32_t(D->Loc.getPointer() - Text.begin()), D->Kind, D->Msg};
+    return Result;
+  }
+  raw_string_ostream OS(Result.AST);
+  astfile::write(FlatAST::build(Decls), OS);
+  return Result;
+}
+
+static bool matchesFullParse(const IncrementalParser &Inc, StringRef Text,
+                             const FullParse &Full) {
+  if (Full.Error || Inc.getText() != Text)
+    return false;
+  TokenStream Tokens = Inc.getTokens();
+  if (Tokens.kinds() != Full.Tokens.kinds() ||
+      Tokens.offsets() != Full.Tokens.offsets() ||
+      Tokens.lengths() != Full.Tokens.lengths())
+    return false;
+  std::string AST;
+  raw_string_ostream OS(AST);
+  astfile::write(FlatAST::build(Inc.getDecls()), OS);
+  return OS.str() == Full.AST;
+}
+
+static std::string unescapeNewlines(StringRef S) {
+  std::string Result;
+  for (size_t I = 0, E = S.size(); I != E; ++I) {
+    if (S[I] == '\\' && I + 1 != E && S[I + 1] == 'n') {
+      Result += '\n';
+      ++I;
+    } else {
+      Result += S[I];
+    }
+  }
+  return Result;
+}
+
+// Parses Source with an IncrementalParser and applies --edit to it. After
+// every edit the result must match a full parse of the text: the same tokens
+// and declarations, or the same first error if the edit is rejected, with
+// the previous text kept.
+static int runEdits(SourceMgr &SrcMgr, IdentifierTable &Idents,
+                    StringRef Source) {
+  IncrementalParser Inc(SrcMgr, Idents, inputFile,
+                        std::max(1u, unsigned(segmentSize)));
+  std::string Text = Source.str();
+  auto PrintError = [&](StringRef Text,
+                        const IncrementalParser::ParseError &E) {
+    unsigned ID = SrcMgr.AddNewSourceBuffer(
+        MemoryBuffer::getMemBufferCopy(Text, inputFile), SMLoc());
+    SrcMgr.PrintMessage(
+        SMLoc::getFromPointer(SrcMgr.getMemoryBuffer(ID)->getBufferStart() +
+                              E.Offset),
+        E.Kind, E.Msg);
+  };
+  if (!Inc.parse(Text)) {
+    PrintError(Text, *Inc.getLastError());
+    return 1;
+  }
+  if (!matchesFullParse(Inc, Text, parseFully(SrcMgr, Idents, Text))) {
+    errs() << "The incremental parse doesn't match a full parse\n";
+    return 1;
+  }
+
+  for (size_t I = 0, E = edits.size(); I != E; ++I) {
+    auto [Old, New] = StringRef(edits[I]).split("=>");
+    std::string OldText = unescapeNewlines(Old);
+    std::string NewText = unescapeNewlines(New);
+    size_t Pos = Text.find(OldText);
+    if (Pos == std::string::npos) {
+      errs() << "Edit " << I + 1 << ": '" << Old << "' not found\n";
+      return 1;
+    }
+    std::string Edited = Text;
+    Edited.replace(Pos, OldText.size(), NewText);
+    FullParse Full = parseFully(SrcMgr, Idents, Edited);
+
+    TextEdit Edit;
+    Edit.Offset = Pos;
+    Edit.RemovedLength = OldText.size();
+    Edit.Inserted = NewText;
+    if (!Inc.applyEdit(Edit)) {
+      const IncrementalParser::ParseError &Error = *Inc.getLastError();
+      outs() << "edit " << I + 1 << ": rejected\n";
+      PrintError(Edited, Error);
+      if (!Full.Error || Full.Error->Offset != Error.Offset ||
+          Full.Error->Msg != Error.Msg) {
+        errs() << "Edit " << I + 1
+               << ": a full parse reports a different error\n";
+        return 1;
+      }
+      if (!matchesFullParse(Inc, Text, parseFully(SrcMgr, Idents, Text))) {
+        errs() << "Edit " << I + 1 << ": the previous text wasn't kept\n";
+        return 1;
+      }
+      continue;
+    }
+
+    Text = std::move(Edited);
+    if (!matchesFullParse(Inc, Text, Full)) {
+      errs() << "Edit " << I + 1 << ": doesn't match a full parse\n";
+      return 1;
+    }
+    outs() << "edit " << I + 1 << ": " << Inc.getNumDecls() << " decls in "
+           << Inc.getNumSegments() << " segments, "
+           << Inc.getLastStats().DeclsReparsed << " re-parsed\n";
+  }
+  return 0;
+}
+
+static bool writeAST(ArrayRef<Decl *> decls) {
+  std::error_code EC;
+  raw_fd_ostream OS(emitAST, EC, sys::fs::OF_None);
+  if (EC) {
+    errs() << "Could not open AST file: " << EC.message() << "\n";
+    return false;
+  }
+  astfile::write(FlatAST::build(decls), OS);
+  return true;
+}
+
+// Reads the AST written by --emit-ast and runs code generation on it, without
+// touching the input file.
+static int runFromASTFile(DiagnosticsEngine &Diags) {
+  // Large files are mapped rather than read.
+  auto FileOrErr = MemoryBuffer::getFile(loadAST, /*IsText=*/false,
+                                         /*RequiresNullTerminator=*/false);
+  if (!FileOrErr) {
+    errs() << "Error opening AST file '" << loadAST
+           << "': " << FileOrErr.getError().message() << "\n";
+    return 1;
+  }
+
+  IdentifierTable Idents;
+  Expected<FlatAST> AST = astfile::read(**FileOrErr, Idents);
+  if (!AST) {
+    errs() << loadAST << ": " << toString(AST.takeError()) << "\n";
+    return 1;
+  }
+  ASTContext Ctx;
+  DeclList decls = AST->toDecls(Ctx);
+  if (!runProgram)
+    outs() << "Successfully loaded " << decls.size() << " declarations.\n";
+  return enableCodeGen || runProgram ? generateCode(decls, Ctx, Diags) : 0;
+}
+
 int main(int argc, char **argv) {
   cl::ParseCommandLineOptions(argc, argv, "tinycc driver\n");
 
+  if (!traceCategories.empty()) {
+    if (!TINYCC_ENABLE_TRACE)
+      errs() << "warning: --trace ignored, trace points are compiled out\n";
+    StringRef Unknown;
+    if (!trace::enable(traceCategories, Unknown)) {
+      errs() << "Unknown trace category '" << Unknown << "'\n";
+      return 1;
+    }
+    if (!traceFile.empty()) {
+      std::error_code EC;
+      auto OS = std::make_unique<raw_fd_ostream>(traceFile, EC,
+                                                 sys::fs::OF_None);
+      if (EC) {
+        errs() << "Could not open trace file: " << EC.message() << "\n";
+        return 1;
+      }
+      trace::setSink(std::move(OS));
+    }
+  }
+
+  if (optLevel > 3) {
+    errs() << "Invalid optimization level -O" << optLevel << "\n";
+    return 1;
+  }
+
+  if (numThreads)
+    parallel::strategy = hardware_concurrency(numThreads);
+
   // Set up source manager and diagnostics
   SourceMgr SrcMgr;
   DiagnosticsEngine Diags(SrcMgr);
 
-  // Read input file
+  if (!loadAST.empty())
+    return runFromASTFile(Diags);
+
+  // Read input file. The lexer works on explicit buffer bounds, so the buffer
+  // doesn't need a NUL terminator; that lets large inputs be mapped straight
+  // from the page cache instead of copied.
   llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> FileOrErr =
-      llvm::MemoryBuffer::getFile(inputFile);
+      llvm::MemoryBuffer::getFile(inputFile, /*IsText=*/false,
+                                  /*RequiresNullTerminator=*/false,
+                                  /*IsVolatile=*/false);
 
   if (!FileOrErr) {
     errs() << "Error opening file '" << inputFile << "': "
@@ -47,18 +456,36 @@ int main(int argc, char **argv) {
   }
 
   SrcMgr.AddNewSourceBuffer(std::move(*FileOrErr), llvm::SMLoc());
-  Lexer lexer(SrcMgr, Diags);
+  IdentifierTable Idents;
+  if (enableParser && !edits.empty())
+    return runEdits(SrcMgr, Idents,
+                    SrcMgr.getMemoryBuffer(SrcMgr.getMainFileID())
+                        ->getBuffer());
+  Lexer lexer(SrcMgr, Diags, Idents);
+  TokenStream tokens;
+  bool buildStream = useTokenStream || parallelLex || dumpTokens ||
+                     lazyBodies || parallelParse;
+  size_t chunkSize = parallelLex ? std::max(1u, unsigned(lexChunkSize)) : 0;
 
   // Run lexer if enabled
   if (enableLexer) {
     LexerDriver driver(lexer);
-    driver.run();
+    driver.run(buildStream ? &tokens : nullptr, chunkSize);
+    if (dumpTokens)
+      printTokens(tokens, lexer.getBuffer());
     return 0;
   }
 
   // Run parser and optionally code generation
-  if (enableParser || enableCodeGen) {
-    ParserDriver parser(lexer, Diags);
+  if (enableParser || enableCodeGen || runProgram) {
+    if (buildStream)
+      LexerDriver(lexer).run(&tokens, chunkSize);
+    ASTContext Ctx;
+    ParserDriver parser = buildStream
+                              ? ParserDriver(lexer, tokens, Diags, Ctx)
+                              : ParserDriver(lexer, Diags, Ctx);
+    parser.setLazyBodies(lazyBodies);
+    parser.setParallelBodies(parallelParse);
     auto decls = parser.parse();
 
     // Check for parsing errors
@@ -67,34 +494,22 @@ int main(int argc, char **argv) {
       return 1;
     }
 
-    outs() << "Successfully parsed " << decls.size() << " declarations.\n";
+    // The output of a program run with --run is its own
+    if (!runProgram)
+      outs() << "Successfully parsed " << decls.size() << " declarations.\n";
 
-    // Run code generation if enabled
-    if (enableCodeGen) {
-      // Generate LLVM IR
-      CodeGenerator CodeGen(Diags);
-      if (!CodeGen.generateCode(decls)) {
-        errs() << "Code generation failed.\n";
-        return 1;
-      }
-
-      // Write LLVM IR to output file
-      std::error_code EC;
-      raw_fd_ostream OS(outputFile, EC, sys::fs::OF_None);
-      if (EC) {
-        errs() << "Could not open output file: " << EC.message() << "\n";
-        return 1;
-      }
+    if (!emitAST.empty() && !writeAST(decls))
+      return 1;
 
-      CodeGen.print(OS);
-      outs() << "Generated LLVM IR written to " << outputFile << "\n";
-    }
+    // Run code generation if enabled
+    if (enableCodeGen || runProgram)
+      return generateCode(decls, Ctx, Diags);
 
     return 0;
   }
 
   // No action specified, show help
-  errs() << "No action specified. Use --lex, --parse, or --codegen.\n";
+  errs() << "No action specified. Use --lex, --parse, --codegen or --run.\n";
   cl::PrintHelpMessage();
   return 1;
 }
@@ -0,0 +1,302 @@
+#include "Lexer/CharScan.h"
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) ||            \
+    defined(_M_IX86)
+#define TINYCC_SCAN_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TINYCC_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TINYCC_TARGET_AVX2
+#endif
+
+using namespace tinycc;
+
+namespace {
+using ScanFn = const char *(*)(const char *, const char *);
+
+struct Kernels {
+  ScanFn SkipWhitespace;
+  ScanFn SkipIdentifierBody;
+  ScanFn FindLineEnd;
+  ScanFn FindBlockCommentEnd;
+};
+
+//===----------------------------------------------------------------------===//
+// Scalar kernels, also used for the tails of the vector loops.
+//===----------------------------------------------------------------------===//
+
+const char *skipWhitespaceScalar(const char *Ptr, const char *End) {
+  while (Ptr != End && charinfo::isWhitespace(*Ptr))
+    ++Ptr;
+  return Ptr;
+}
+
+const char *skipIdentifierBodyScalar(const char *Ptr, const char *End) {
+  while (Ptr != End && charinfo::isIdentifierBody(*Ptr))
+    ++Ptr;
+  return Ptr;
+}
+
+const char *findLineEndScalar(const char *Ptr, const char *End) {
+  while (Ptr != End && *Ptr != '\n')
+    ++Ptr;
+  return Ptr;
+}
+
+const char *findBlockCommentEndScalar(const char *Ptr, const char *End) {
+  for (; End - Ptr >= 2; ++Ptr)
+    if (Ptr[0] == '*' && Ptr[1] == '/')
+      return Ptr;
+  return End;
+}
+
+#ifdef TINYCC_SCAN_X86
+inline unsigned firstSetBit(uint32_t Mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  unsigned long Idx;
+  _BitScanForward(&Idx, Mask);
+  return Idx;
+#else
+  return __builtin_ctz(Mask);
+#endif
+}
+
+//===----------------------------------------------------------------------===//
+// SSE2 kernels, 16 bytes per step. SSE2 only has signed byte compares, which
+// is fine here: every class we test for is plain ASCII, and bytes >= 0x80 are
+// negative so they never land inside a range.
+//===----------------------------------------------------------------------===//
+
+inline __m128i inRange16(__m128i V, char Lo, char Hi) {
+  return _mm_and_si128(_mm_cmpgt_epi8(V, _mm_set1_epi8(Lo - 1)),
+                       _mm_cmplt_epi8(V, _mm_set1_epi8(Hi + 1)));
+}
+
+inline __m128i whitespace16(__m128i V) {
+  // ' ' plus the contiguous '\t' '\n' '\v' '\f' '\r' block.
+  return _mm_or_si128(_mm_cmpeq_epi8(V, _mm_set1_epi8(' ')),
+                      inRange16(V, '\t', '\r'));
+}
+
+inline __m128i identifierBody16(__m128i V) {
+  __m128i Lower = _mm_or_si128(V, _mm_set1_epi8(0x20));
+  return _mm_or_si128(
+      _mm_or_si128(inRange16(Lower, 'a', 'z'), inRange16(V, '0', '9')),
+      _mm_cmpeq_epi8(V, _mm_set1_epi8('_')));
+}
+
+inline __m128i load16(const char *Ptr) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i *>(Ptr));
+}
+
+const char *skipWhitespaceSSE2(const char *Ptr, const char *End) {
+  for (; End - Ptr >= 16; Ptr += 16) {
+    uint32_t Miss = ~_mm_movemask_epi8(whitespace16(load16(Ptr))) & 0xFFFFu;
+    if (Miss)
+      return Ptr + firstSetBit(Miss);
+  }
+  return skipWhitespaceScalar(Ptr, End);
+}
+
+const char *skipIdentifierBodySSE2(const char *Ptr, const char *End) {
+  for (; End - Ptr >= 16; Ptr += 16) {
+    uint32_t Miss =
+        ~_mm_movemask_epi8(identifierBody16(load16(Ptr))) & 0xFFFFu;
+    if (Miss)
+      return Ptr + firstSetBit(Miss);
+  }
+  return skipIdentifierBodyScalar(Ptr, End);
+}
+
+const char *findLineEndSSE2(const char *Ptr, const char *End) {
+  const __m128i NL = _mm_set1_epi8('\n');
+  for (; End - Ptr >= 16; Ptr += 16) {
+    uint32_t Hit = _mm_movemask_epi8(_mm_cmpeq_epi8(load16(Ptr), NL));
+    if (Hit)
+      return Ptr + firstSetBit(Hit);
+  }
+  return findLineEndScalar(Ptr, End);
+}
+
+const char *findBlockCommentEndSSE2(const char *Ptr, const char *End) {
+  const __m128i Star = _mm_set1_epi8('*');
+  const __m128i Slash = _mm_set1_epi8('/');
+  // Compare the block against itself shifted by one byte so that a "*/"
+  // straddling two blocks is still found.
+  for (; End - Ptr >= 17; Ptr += 16) {
+    __m128i Pair = _mm_and_si128(_mm_cmpeq_epi8(load16(Ptr), Star),
+                                 _mm_cmpeq_epi8(load16(Ptr + 1), Slash));
+    uint32_t Hit = _mm_movemask_epi8(Pair);
+    if (Hit)
+      return Ptr + firstSetBit(Hit);
+  }
+  return findBlockCommentEndScalar(Ptr, End);
+}
+
+//===----------------------------------------------------------------------===//
+// AVX2 kernels, 32 bytes per step. Same classification as the SSE2 ones.
+//===----------------------------------------------------------------------===//
+
+TINYCC_TARGET_AVX2 inline __m256i inRange32(__m256i V, char Lo, char Hi) {
+  return _mm256_and_si256(_mm256_cmpgt_epi8(V, _mm256_set1_epi8(Lo - 1)),
+                          _mm256_cmpgt_epi8(_mm256_set1_epi8(Hi + 1), V));
+}
+
+TINYCC_TARGET_AVX2 inline __m256i whitespace32(__m256i V) {
+  return _mm256_or_si256(_mm256_cmpeq_epi8(V, _mm256_set1_epi8(' ')),
+                         inRange32(V, '\t', '\r'));
+}
+
+TINYCC_TARGET_AVX2 inline __m256i identifierBody32(__m256i V) {
+  __m256i Lower = _mm256_or_si256(V, _mm256_set1_epi8(0x20));
+  return _mm256_or_si256(
+      _mm256_or_si256(inRange32(Lower, 'a', 'z'), inRange32(V, '0', '9')),
+      _mm256_cmpeq_epi8(V, _mm256_set1_epi8('_')));
+}
+
+TINYCC_TARGET_AVX2 inline __m256i load32(const char *Ptr) {
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Ptr));
+}
+
+TINYCC_TARGET_AVX2 const char *skipWhitespaceAVX2(const char *Ptr,
+                                                  const char *End) {
+  for (; End - Ptr >= 32; Ptr += 32) {
+    uint32_t Miss = ~static_cast<uint32_t>(
+        _mm256_movemask_epi8(whitespace32(load32(Ptr))));
+    if (Miss)
+      return Ptr + firstSetBit(Miss);
+  }
+  return skipWhitespaceSSE2(Ptr, End);
+}
+
+TINYCC_TARGET_AVX2 const char *skipIdentifierBodyAVX2(const char *Ptr,
+                                                      const char *End) {
+  for (; End - Ptr >= 32; Ptr += 32) {
+    uint32_t Miss = ~static_cast<uint32_t>(
+        _mm256_movemask_epi8(identifierBody32(load32(Ptr))));
+    if (Miss)
+      return Ptr + firstSetBit(Miss);
+  }
+  return skipIdentifierBodySSE2(Ptr, End);
+}
+
+TINYCC_TARGET_AVX2 const char *findLineEndAVX2(const char *Ptr,
+                                               const char *End) {
+  const __m256i NL = _mm256_set1_epi8('\n');
+  for (; End - Ptr >= 32; Ptr += 32) {
+    uint32_t Hit = static_cast<uint32_t>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(load32(Ptr), NL)));
+    if (Hit)
+      return Ptr + firstSetBit(Hit);
+  }
+  return findLineEndSSE2(Ptr, End);
+}
+
+TINYCC_TARGET_AVX2 const char *findBlockCommentEndAVX2(const char *Ptr,
+                                                       const char *End) {
+  const __m256i Star = _mm256_set1_epi8('*');
+  const __m256i Slash = _mm256_set1_epi8('/');
+  for (; End - Ptr >= 33; Ptr += 32) {
+    __m256i Pair =
+        _mm256_and_si256(_mm256_cmpeq_epi8(load32(Ptr), Star),
+                         _mm256_cmpeq_epi8(load32(Ptr + 1), Slash));
+    uint32_t Hit = static_cast<uint32_t>(_mm256_movemask_epi8(Pair));
+    if (Hit)
+      return Ptr + firstSetBit(Hit);
+  }
+  return findBlockCommentEndSSE2(Ptr, End);
+}
+
+bool hostHasAVX2() {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_cpu_supports("avx2");
+#else
+  return false;
+#endif
+}
+#endif // TINYCC_SCAN_X86
+
+scan::ISA getBestISA() {
+#ifdef TINYCC_SCAN_X86
+  return hostHasAVX2() ? scan::ISA::AVX2 : scan::ISA::SSE2;
+#else
+  return scan::ISA::Scalar;
+#endif
+}
+
+Kernels getKernels(scan::ISA Kind) {
+  switch (Kind) {
+#ifdef TINYCC_SCAN_X86
+  case scan::ISA::AVX2:
+    return {skipWhitespaceAVX2, skipIdentifierBodyAVX2, findLineEndAVX2,
+            findBlockCommentEndAVX2};
+  case scan::ISA::SSE2:
+    return {skipWhitespaceSSE2, skipIdentifierBodySSE2, findLineEndSSE2,
+            findBlockCommentEndSSE2};
+#endif
+  default:
+    return {skipWhitespaceScalar, skipIdentifierBodyScalar, findLineEndScalar,
+            findBlockCommentEndScalar};
+  }
+}
+
+struct Dispatch {
+  scan::ISA Kind;
+  Kernels K;
+
+  Dispatch() : Kind(getBestISA()), K(getKernels(Kind)) {}
+};
+
+Dispatch &getDispatch() {
+  static Dispatch D;
+  return D;
+}
+} // namespace
+
+scan::ISA scan::getISA() { return getDispatch().Kind; }
+
+scan::ISA scan::setISA(ISA Kind) {
+  if (Kind > getBestISA())
+    Kind = getBestISA();
+  Dispatch &D = getDispatch();
+  D.Kind = Kind;
+  D.K = getKernels(Kind);
+  return Kind;
+}
+
+const char *scan::getISAName(ISA Kind) {
+  switch (Kind) {
+  case ISA::Scalar:
+    return "scalar";
+  case ISA::SSE2:
+    return "sse2";
+  case ISA::AVX2:
+    return "avx2";
+  }
+  return "unknown";
+}
+
+const char *scan::detail::skipWhitespace(const char *Ptr, const char *End) {
+  return getDispatch().K.SkipWhitespace(Ptr, End);
+}
+
+const char *scan::detail::skipIdentifierBody(const char *Ptr,
+                                             const char *End) {
+  return getDispatch().K.SkipIdentifierBody(Ptr, End);
+}
+
+const char *scan::detail::findLineEnd(const char *Ptr, const char *End) {
+  return getDispatch().K.FindLineEnd(Ptr, End);
+}
+
+const char *scan::detail::findBlockCommentEnd(const char *Ptr,
+                                              const char *End) {
+  return getDispatch().K.FindBlockCommentEnd(Ptr, End);
+}
@@ -1,54 +1,17 @@
 #include "Lexer/Lexer.h"
+#include "Lexer/CharInfo.h"
+#include "Lexer/CharScan.h"
+#include "Support/Trace.h"
 #include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/Parallel.h>
+#include <algorithm>
+#include <cstring>
+#include <memory>
 #include <string>
 #include <vector>
 
 using namespace tinycc;
 
-void KeywordFilter::addKeyword(StringRef Keyword, tok::TokenKind TokenCode) {
-  HashTable.insert(std::make_pair(Keyword, TokenCode));
-}
-
-void KeywordFilter::addKeywords() {
-#define KEYWORD(NAME, FLAGS) addKeyword(StringRef(#NAME), tok::kw_##NAME);
-#include "Support/TokenKinds.def"
-}
-
-namespace charinfo {
-LLVM_READNONE inline bool isASCII(char Ch) {
-  return static_cast<unsigned char>(Ch) <= 127;
-}
-
-LLVM_READNONE inline bool isVerticalWhitespace(char Ch) {
-  return isASCII(Ch) && (Ch == '\r' || Ch == '\n');
-}
-
-LLVM_READNONE inline bool isHorizontalWhitespace(char Ch) {
-  return isASCII(Ch) && (Ch == ' ' || Ch == '\t' || Ch == '\f' || Ch == '\v');
-}
-
-LLVM_READNONE inline bool isWhitespace(char Ch) {
-  return isHorizontalWhitespace(Ch) || isVerticalWhitespace(Ch);
-}
-
-LLVM_READNONE inline bool isDigit(char Ch) {
-  return isASCII(Ch) && Ch >= '0' && Ch <= '9';
-}
-
-LLVM_READNONE inline bool isHexDigit(char Ch) {
-  return isASCII(Ch) && (isDigit(Ch) || (Ch >= 'A' && Ch <= 'F'));
-}
-
-LLVM_READNONE inline bool isIdentifierHead(char Ch) {
-  return isASCII(Ch) &&
-         (Ch == '_' || (Ch >= 'A' && Ch <= 'Z') || (Ch >= 'a' && Ch <= 'z'));
-}
-
-LLVM_READNONE inline bool isIdentifierBody(char Ch) {
-  return isIdentifierHead(Ch) || isDigit(Ch);
-}
-} // namespace charinfo
-
 void Lexer::next(Token &Result) {
   if (HasLookahead) {
     Result = LookaheadToken;
@@ -56,11 +19,9 @@ void Lexer::next(Token &Result) {
     return;
   }
 
-  while (*CurPtr && charinfo::isWhitespace(*CurPtr)) {
-    ++CurPtr;
-  }
-  if (!*CurPtr) {
-    Result.setKind(tok::eof);
+  CurPtr = scan::skipWhitespace(CurPtr, BufEnd);
+  if (CurPtr == BufEnd) {
+    formToken(Result, CurPtr, tok::eof);
     return;
   }
   if (charinfo::isIdentifierHead(*CurPtr)) {
@@ -91,7 +52,7 @@ void Lexer::next(Token &Result) {
       CASE('>', tok::greater);
 #undef CASE
     case '/':
-      if (*(CurPtr + 1) == '/' || *(CurPtr + 1) == '*') {
+      if (peekChar(CurPtr + 1) == '/' || peekChar(CurPtr + 1) == '*') {
         comment();
         // After skipping a comment, restart the lexing process
         return next(Result);
@@ -109,9 +70,7 @@ void Lexer::next(Token &Result) {
 
 void Lexer::identifier(Token &Result) {
   const char *Start = CurPtr;
-  const char *End = CurPtr + 1;
-  while (charinfo::isIdentifierBody(*End))
-    ++End;
+  const char *End = scan::skipIdentifierBody(CurPtr + 1, BufEnd);
   StringRef Name(Start, End - Start);
 
   // Check for keywords
@@ -129,31 +88,33 @@ void Lexer::number(Token &Result) {
   bool IsFloat = false;
 
   // Check for hex (0x) or octal (0) prefix
-  if (*End == '0') {
+  if (peekChar(End) == '0') {
     ++End;
-    if (*End == 'x' || *End == 'X') {
+    if (peekChar(End) == 'x' || peekChar(End) == 'X') {
       IsHex = true;
       ++End;
       // At least one hex digit required after 0x
-      if (!charinfo::isHexDigit(*End)) {
-        Diags.report(getLoc(End), diag::invalid_suffix_in_constant, *End);
+      if (!charinfo::isHexDigit(peekChar(End))) {
+        Diags.report(getLoc(End), diag::invalid_suffix_in_constant,
+                     peekChar(End));
         formToken(Result, End, tok::integer_cons);
         return;
       }
-    } else if (charinfo::isDigit(*End)) {
+    } else if (charinfo::isDigit(peekChar(End))) {
       IsOctal = true;
-    } else if (*End == '.') {
+    } else if (peekChar(End) == '.') {
       // This is a float like "0.123"
       IsFloat = true;
       ++End;
     }
-  } else if (*End == '.') {
+  } else if (peekChar(End) == '.') {
     // This is a float like ".123"
     IsFloat = true;
     ++End;
     // Must have at least one digit after the decimal point
-    if (!charinfo::isDigit(*End)) {
-      Diags.report(getLoc(End), diag::invalid_suffix_in_constant, *End);
+    if (!charinfo::isDigit(peekChar(End))) {
+      Diags.report(getLoc(End), diag::invalid_suffix_in_constant,
+                   peekChar(End));
       formToken(Result, End, tok::unknown);
       return;
     }
@@ -161,12 +122,13 @@ void Lexer::number(Token &Result) {
 
   // Consume all valid digits based on the number type
   while (true) {
-    if (IsHex && charinfo::isHexDigit(*End)) {
+    if (IsHex && charinfo::isHexDigit(peekChar(End))) {
       ++End;
-    } else if ((IsOctal && *End >= '0' && *End <= '7') ||
-               (!IsHex && !IsOctal && !IsFloat && charinfo::isDigit(*End))) {
+    } else if ((IsOctal && peekChar(End) >= '0' && peekChar(End) <= '7') ||
+               (!IsHex && !IsOctal && !IsFloat &&
+                charinfo::isDigit(peekChar(End)))) {
       ++End;
-    } else if (IsFloat && charinfo::isDigit(*End)) {
+    } else if (IsFloat && charinfo::isDigit(peekChar(End))) {
       ++End;
     } else {
       break;
@@ -174,65 +136,69 @@ void Lexer::number(Token &Result) {
   }
 
   // Check for decimal point in non-float numbers
-  if (!IsFloat && !IsHex && !IsOctal && *End == '.') {
+  if (!IsFloat && !IsHex && !IsOctal && peekChar(End) == '.') {
     IsFloat = true;
     ++End;
     // Consume digits after decimal point
-    while (charinfo::isDigit(*End)) {
+    while (charinfo::isDigit(peekChar(End))) {
       ++End;
     }
   }
 
   // Check for exponent in float numbers (e.g., 1.23e+45)
-  if (IsFloat && (*End == 'e' || *End == 'E')) {
+  if (IsFloat && (peekChar(End) == 'e' || peekChar(End) == 'E')) {
     const char *ExpStart = End;
     ++End;
 
     // Optional sign
-    if (*End == '+' || *End == '-') {
+    if (peekChar(End) == '+' || peekChar(End) == '-') {
       ++End;
     }
 
     // Must have at least one digit in exponent
-    if (!charinfo::isDigit(*End)) {
+    if (!charinfo::isDigit(peekChar(End))) {
       Diags.report(getLoc(ExpStart), diag::invalid_suffix_in_constant, *ExpStart);
       formToken(Result, ExpStart, tok::float_cons);
       return;
     }
 
     // Consume exponent digits
-    while (charinfo::isDigit(*End)) {
+    while (charinfo::isDigit(peekChar(End))) {
       ++End;
     }
   }
 
   // Check for invalid suffixes or characters
-  if (*End && !charinfo::isWhitespace(*End) && *End != ';' && *End != ',' &&
-      *End != ')' && *End != ']' && *End != '}') {
+  if (End != BufEnd && !charinfo::isWhitespace(*End) && *End != ';' &&
+      *End != ',' && *End != ')' && *End != ']' && *End != '}') {
     const char *InvalidSuffix = End;
     Diags.report(getLoc(InvalidSuffix), diag::invalid_suffix_in_constant,
                  *InvalidSuffix);
 
     // Skip the invalid suffix
-    while (*End && !charinfo::isWhitespace(*End) && *End != ';' &&
-           *End != ',' && *End != ')' && *End != ']' && *End != '}') {
+    while (End != BufEnd && !charinfo::isWhitespace(*End) &&
+           *End != ';' && *End != ',' && *End != ')' && *End != ']' &&
+           *End != '}') {
       ++End;
     }
   }
 
   // Form the token
-  llvm::outs() << "IsFloat: " << IsFloat << "\n";
+  TINYCC_TRACE(Lexer, "number '" << StringRef(Start, End - Start)
+                                   << "' IsFloat: " << IsFloat);
   formToken(Result, End, IsFloat ? tok::float_cons : tok::integer_cons);
 }
 
 void Lexer::string(Token &Result) {
   const char *Start = CurPtr;
   const char *End = CurPtr + 1;
-  while (*End && *End != *Start && !charinfo::isVerticalWhitespace(*End))
+  while (End != BufEnd && *End != *Start &&
+         !charinfo::isVerticalWhitespace(*End))
     ++End;
-  if (charinfo::isVerticalWhitespace(*End)) {
-    //   Diags.report(getLoc(), diag::err_unterminated_char_or_string);
-    exit(1);
+  if (End == BufEnd || charinfo::isVerticalWhitespace(*End)) {
+    Diags.report(getLoc(), diag::err_unterminated_char_or_string, *Start);
+    formToken(Result, End, tok::unknown);
+    return;
   }
   formToken(Result, End + 1, tok::identifier);
 }
@@ -240,8 +206,12 @@ void Lexer::string(Token &Result) {
 // Generate token from tokend and curptr
 void Lexer::formToken(Token &Result, const char *TokEnd, tok::TokenKind Kind) {
   size_t TokLen = TokEnd - CurPtr;
-  Result.Ptr = CurPtr;
-  Result.Length = TokLen;
+  if (TokLen > Token::MaxLength) {
+    Diags.report(getLoc(), diag::err_token_too_long, TokLen, Token::MaxLength);
+    TokLen = Token::MaxLength;
+  }
+  Result.Offset = static_cast<uint32_t>(CurPtr - CurBuf.begin());
+  Result.Length = static_cast<uint32_t>(TokLen);
   Result.Kind = Kind;
 
   // For debugging purposes, you can uncomment this to print token information
@@ -253,6 +223,119 @@ void Lexer::formToken(Token &Result, const char *TokEnd, tok::TokenKind Kind) {
   CurPtr = TokEnd;
 }
 
+void Lexer::checkBufferSize() {
+  if (CurBuf.size() > UINT32_MAX)
+    Diags.report(getLoc(), diag::err_buffer_too_large, CurBuf.size());
+}
+
+void Lexer::lexAll(TokenStream &Tokens) {
+  // C source averages a few bytes per token, so this avoids most regrowth
+  // without overcommitting much.
+  Tokens.reserve(Tokens.size() + (BufEnd - CurPtr) / 4 + 1);
+  Token Tok;
+  do {
+    next(Tok);
+    Tokens.push_back(Tok);
+    // Lexing would go on past an error reported to a deferring engine
+    if (Diags.getFirstDeferred())
+      return;
+  } while (!Tok.is(tok::eof));
+}
+
+// Splits [Begin, End) into chunks of roughly ChunkSize bytes and returns the
+// chunk start positions followed by End. Every chunk starts at the beginning of
+// a line that is provably outside a block comment; no token spans a newline, so
+// lexing the chunks separately yields the same tokens as lexing the whole
+// range. Comments are skipped with the vector scanning kernels, which keeps
+// this pre-scan much faster than lexing itself.
+static std::vector<const char *>
+splitIntoChunks(const char *Begin, const char *End, size_t ChunkSize) {
+  auto NextTarget = [&](const char *From) {
+    return size_t(End - From) > ChunkSize ? From + ChunkSize : End;
+  };
+  std::vector<const char *> Starts{Begin};
+  const char *Target = NextTarget(Begin);
+  const char *Ptr = Begin;
+  while (Ptr != End && Target != End) {
+    const char *Slash =
+        static_cast<const char *>(std::memchr(Ptr, '/', End - Ptr));
+    if (!Slash)
+      Slash = End;
+
+    // [Ptr, Slash) can't open a comment, so the first newline in it at or
+    // past the target is a safe place to split.
+    if (Slash > Target) {
+      const char *NL = scan::findLineEnd(std::max(Ptr, Target), Slash);
+      if (NL != Slash) {
+        Ptr = NL + 1;
+        if (Ptr != End)
+          Starts.push_back(Ptr);
+        Target = NextTarget(Ptr);
+        continue;
+      }
+    }
+
+    if (Slash == End)
+      break;
+    if (Slash + 1 != End && Slash[1] == '*') {
+      const char *CommentEnd = scan::findBlockCommentEnd(Slash + 2, End);
+      Ptr = CommentEnd == End ? End : CommentEnd + 2;
+    } else if (Slash + 1 != End && Slash[1] == '/') {
+      // Stop on the newline itself; it is outside the comment.
+      Ptr = scan::findLineEnd(Slash + 2, End);
+    } else {
+      Ptr = Slash + 1;
+    }
+  }
+  Starts.push_back(End);
+  return Starts;
+}
+
+void Lexer::lexAllParallel(TokenStream &Tokens, size_t ChunkSize) {
+  if (HasLookahead) {
+    Token Tok;
+    next(Tok);
+    Tokens.push_back(Tok);
+    if (Tok.is(tok::eof))
+      return;
+  }
+
+  std::vector<const char *> Starts = splitIntoChunks(CurPtr, BufEnd, ChunkSize);
+  size_t NumChunks = Starts.size() - 1;
+  if (NumChunks < 2) {
+    lexAll(Tokens);
+    return;
+  }
+
+  // Each chunk reports to an engine of its own that keeps its first error, so
+  // that the error reported is the first in the source
+  std::vector<TokenStream> Chunks(NumChunks);
+  std::vector<std::unique_ptr<DiagnosticsEngine>> ChunkDiags(NumChunks);
+  std::vector<size_t> Indices(NumChunks);
+  for (size_t I = 0; I != NumChunks; ++I) {
+    Indices[I] = I;
+    ChunkDiags[I] =
+        std::make_unique<DiagnosticsEngine>(SrcMgr, /*Deferring=*/true);
+  }
+  llvm::parallelForEach(Indices, [&](size_t I) {
+    Lexer ChunkLexer(*this, *ChunkDiags[I], Starts[I], Starts[I + 1]);
+    ChunkLexer.lexAll(Chunks[I]);
+  });
+  for (const auto &D : ChunkDiags)
+    if (const auto &First = D->getFirstDeferred())
+      Diags.report(*First);
+
+  // Stitch the chunks together, dropping the eof that ends every chunk but
+  // the last.
+  size_t Total = Tokens.size();
+  for (const TokenStream &Chunk : Chunks)
+    Total += Chunk.size() - 1;
+  Tokens.reserve(Total + 1);
+  for (size_t I = 0; I != NumChunks; ++I)
+    Tokens.append(Chunks[I], 0, Chunks[I].size() - (I + 1 != NumChunks));
+  CurPtr = BufEnd;
+}
+
 Token &Lexer::lookAhead() {
   if (!HasLookahead) {
     next(LookaheadToken);
@@ -265,24 +348,20 @@ Token &Lexer::lookAhead() {
 void Lexer::comment() {
   assert(*CurPtr == '/' && "Expected comment start with /");
 
-  if (*(CurPtr + 1) == '/') {
+  if (peekChar(CurPtr + 1) == '/') {
     // Single line comment, skip to end of line
-    CurPtr += 2; // Skip the '//'
-    while (*CurPtr && *CurPtr != '\n')
-      ++CurPtr;
-    if (*CurPtr == '\n')
+    CurPtr = scan::findLineEnd(CurPtr + 2, BufEnd);
+    if (CurPtr != BufEnd)
       ++CurPtr; // Consume the newline
-  } else if (*(CurPtr + 1) == '*') {
+  } else if (peekChar(CurPtr + 1) == '*') {
     // Multi-line comment, skip until */
-    CurPtr += 2; // Skip the '/*'
-    while (*CurPtr && !(*CurPtr == '*' && *(CurPtr + 1) == '/')) {
-      ++CurPtr;
-      if (!*CurPtr) {
-        Diags.report(getLoc(), diag::err_unterminated_block_comment);
-        return;
-      }
+    const char *CommentEnd =
+        scan::findBlockCommentEnd(CurPtr + 2, BufEnd);
+    if (CommentEnd == BufEnd) {
+      Diags.report(getLoc(), diag::err_unterminated_block_comment);
+      CurPtr = CommentEnd;
+      return;
     }
-    if (*CurPtr)
-      CurPtr += 2; // Skip the '*/'
+    CurPtr = CommentEnd + 2; // Skip the '*/'
   }
 }
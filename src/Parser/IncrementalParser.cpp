@@ -0,0 +1,210 @@
+#include "Parser/IncrementalParser.h"
+#include "Lexer/Lexer.h"
+#include "Parser/Parser.h"
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <utility>
+
+using namespace tinycc;
+
+IncrementalParser::LexAndParseResult IncrementalParser::lexAndParse(
+    std::shared_ptr<const llvm::MemoryBuffer> Buf, uint32_t TextStart,
+    bool AtEnd, std::vector<std::unique_ptr<Segment>> &Out) {
+  llvm::StringRef Text = Buf->getBuffer();
+  DiagnosticsEngine D(SrcMgr, /*Deferring=*/true);
+  Lexer Lex(SrcMgr, D, Idents, Text);
+  TokenStream Tokens;
+  Lex.lexAll(Tokens);
+  LastStats.TokensRelexed += Tokens.size();
+
+  // Keeps the first error if no text after this could change it: text
+  // appended can only continue the last token, or a comment or line left
+  // open, and the parser looks at no token past the one it reports at
+  bool LexError = D.getFirstDeferred().has_value();
+  auto Fail = [&] {
+    const DiagnosticsEngine::DeferredDiagnostic &Diag = *D.getFirstDeferred();
+    const char *Ptr = Diag.Loc.getPointer();
+    size_t Offset = Ptr && Ptr >= Text.begin() && Ptr <= Text.end()
+                        ? Ptr - Text.begin()
+                        : 0;
+    bool Final;
+    if (!Ptr)
+      Final = false;
+    else if (LexError)
+      Final = Text.find('\n', Offset) != llvm::StringRef::npos &&
+              Text.substr(Offset, 2) != "/*";
+    else
+      Final = Tokens.size() >= 2 &&
+              Offset < Tokens.getOffset(Tokens.size() - 2);
+    if (!AtEnd && !Final)
+      return LexAndParseResult::NeedsMore;
+    LastError = ParseError{uint32_t(TextStart + Offset), Diag.Kind, Diag.Msg};
+    return LexAndParseResult::Error;
+  };
+  if (LexError)
+    return Fail();
+
+  // Lexing the next segment on its own must start as lexing on into it would:
+  // outside any token or comment. Only whitespace, or comments closed by a
+  // final newline, may follow the last token.
+  if (!AtEnd) {
+    size_t Last = Tokens.size() - 1;
+    llvm::StringRef Tail = Text.substr(
+        Last ? Tokens.getOffset(Last - 1) + Tokens.getLength(Last - 1) : 0);
+    if (!Tail.empty() && Tail.back() != '\n' &&
+        Tail.find_first_not_of(" \t\r\n\v\f") != llvm::StringRef::npos)
+      return LexAndParseResult::NeedsMore;
+  }
+
+  // The parser goes on after an error reported to a deferring engine, so
+  // stop at the first one
+  Parser P(Lex, Tokens, D, Ctx, 0);
+  std::vector<std::pair<size_t, Decl *>> Parsed;
+  while (!P.atEOF()) {
+    Decl *Dcl = P.parseNextTopLevelDecl();
+    if (D.getFirstDeferred())
+      return Fail();
+    if (Dcl)
+      Parsed.emplace_back(P.getTokenIndex(), Dcl);
+  }
+  LastStats.DeclsReparsed += Parsed.size();
+
+  // Split the text after declarations ending in ';' or '}', which no token
+  // can continue, once a segment has SegmentSize bytes and the rest has at
+  // least half that
+  auto Seg = std::make_unique<Segment>();
+  Seg->Buffer = Buf;
+  size_t SegBeginTok = 0;
+  for (auto [EndTok, Dcl] : Parsed) {
+    Seg->Decls.push_back(Dcl);
+    tok::TokenKind Kind = Tokens.getKind(EndTok - 1);
+    uint32_t Cut = Tokens.getOffset(EndTok - 1) + Tokens.getLength(EndTok - 1);
+    if (Cut - Seg->Begin < SegmentSize || Text.size() - Cut < SegmentSize / 2 ||
+        (Kind != tok::semi && Kind != tok::close_brace))
+      continue;
+    Seg->End = Cut;
+    Seg->Tokens.append(Tokens, SegBeginTok, EndTok);
+    Seg->Tokens.push_back(Token(tok::eof, Cut, 0));
+    Out.push_back(std::move(Seg));
+    Seg = std::make_unique<Segment>();
+    Seg->Buffer = Buf;
+    Seg->Begin = Cut;
+    SegBeginTok = EndTok;
+  }
+  Seg->End = Text.size();
+  Seg->Tokens.append(Tokens, SegBeginTok, Tokens.size());
+  Out.push_back(std::move(Seg));
+  return LexAndParseResult::Parsed;
+}
+
+bool IncrementalParser::parse(llvm::StringRef Source) {
+  LastStats = Stats();
+  LastError.reset();
+
+  std::shared_ptr<const llvm::MemoryBuffer> Buf =
+      llvm::MemoryBuffer::getMemBufferCopy(Source, BufferName);
+  std::vector<std::unique_ptr<Segment>> New;
+  if (lexAndParse(Buf, 0, /*AtEnd=*/true, New) != LexAndParseResult::Parsed)
+    return false;
+
+  Segments = std::move(New);
+  Sizes.clear();
+  for (const auto &S : Segments)
+    Sizes.push_back(S->End - S->Begin);
+  NumDecls = LastStats.DeclsReparsed;
+  return true;
+}
+
+bool IncrementalParser::applyEdit(const TextEdit &Edit) {
+  assert(!Segments.empty() && "applyEdit() before parse()");
+  LastStats = Stats();
+  LastError.reset();
+
+  // Find the segments holding the start and the end of the edit. An insertion
+  // between two segments goes to the second.
+  size_t First = 0, FirstStart = 0;
+  while (First + 1 != Sizes.size() && FirstStart + Sizes[First] <= Edit.Offset)
+    FirstStart += Sizes[First++];
+  size_t EditEnd = Edit.Offset + Edit.RemovedLength;
+  size_t Last = First, LastStart = FirstStart;
+  while (Last + 1 != Sizes.size() && LastStart + Sizes[Last] < EditEnd)
+    LastStart += Sizes[Last++];
+  assert(Edit.Offset >= FirstStart && EditEnd <= LastStart + Sizes[Last] &&
+         "edit out of range");
+
+  std::string Text;
+  Text += Segments[First]->getText().substr(0, Edit.Offset - FirstStart);
+  Text += Edit.Inserted;
+  Text += Segments[Last]->getText().substr(EditEnd - LastStart);
+
+  // Segments [First, End) are replaced by New
+  size_t End = Last + 1;
+  std::vector<std::unique_ptr<Segment>> New;
+  while (true) {
+    std::shared_ptr<const llvm::MemoryBuffer> Buf =
+        llvm::MemoryBuffer::getMemBufferCopy(Text, BufferName);
+    New.clear();
+    LexAndParseResult Result =
+        lexAndParse(Buf, FirstStart, End == Segments.size(), New);
+    if (Result == LexAndParseResult::Parsed)
+      break;
+    if (Result == LexAndParseResult::Error)
+      return false;
+
+    // The edited text runs on into the next segments, e.g. because it opens a
+    // comment. Take in as many segments again as it spans, so that an edit
+    // running to the end of the text costs time linear in what it spans.
+    size_t Take = std::min(Segments.size() - End, End - First);
+    for (size_t I = 0; I != Take; ++I)
+      Text += Segments[End++]->getText();
+  }
+
+  // Drop a segment emptied by the edit, unless it is the only one
+  if (New.size() == 1 && New[0]->Begin == New[0]->End &&
+      Segments.size() != End - First)
+    New.clear();
+
+  for (size_t I = First; I != End; ++I)
+    NumDecls -= Segments[I]->Decls.size();
+  NumDecls += LastStats.DeclsReparsed;
+  LastStats.DeclsReused = NumDecls - LastStats.DeclsReparsed;
+
+  std::vector<uint32_t> NewSizes;
+  for (const auto &S : New)
+    NewSizes.push_back(S->End - S->Begin);
+  Segments.erase(Segments.begin() + First, Segments.begin() + End);
+  Segments.insert(Segments.begin() + First, std::make_move_iterator(New.begin()),
+                  std::make_move_iterator(New.end()));
+  Sizes.erase(Sizes.begin() + First, Sizes.begin() + End);
+  Sizes.insert(Sizes.begin() + First, NewSizes.begin(), NewSizes.end());
+  return true;
+}
+
+std::string IncrementalParser::getText() const {
+  std::string Text;
+  for (const auto &S : Segments)
+    Text += S->getText();
+  return Text;
+}
+
+TokenStream IncrementalParser::getTokens() const {
+  TokenStream Tokens;
+  size_t Start = 0;
+  for (size_t I = 0, E = Segments.size(); I != E; ++I) {
+    // Every segment's tokens end with an eof; only the last one is kept
+    const Segment &S = *Segments[I];
+    Tokens.append(S.Tokens, 0, S.Tokens.size() - (I + 1 != E),
+                  int64_t(Start) - S.Begin);
+    Start += Sizes[I];
+  }
+  return Tokens;
+}
+
+DeclList IncrementalParser::getDecls() const {
+  DeclList Decls;
+  Decls.reserve(NumDecls);
+  for (const auto &S : Segments)
+    Decls.insert(Decls.end(), S->Decls.begin(), S->Decls.end());
+  return Decls;
+}
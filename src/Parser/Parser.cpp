@@ -1,7 +1,11 @@
 #include "Parser/Parser.h"
 #include "AST/AST.h"
+#include "Support/Trace.h"
 #include <llvm/ADT/APInt.h>
 #include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/Parallel.h>
+#include <llvm/Support/Threading.h>
+#include <array>
 #include <memory>
 
 using namespace tinycc;
@@ -19,88 +23,150 @@ bool Parser::expect(tok::TokenKind Kind) {
   if (CurTok.is(Kind)) {
     return true;
   }
-  Diags.report(CurTok.getLocation(), diag::err_expected,
+  Diags->report(Lex.getLocation(CurTok), diag::err_expected,
                tok::getTokenName(Kind), StringRef(CurTok.getName()));
   return false;
 }
 
 // Main entry point for parsing
-std::vector<std::unique_ptr<Decl>> Parser::parse() {
-  std::vector<std::unique_ptr<Decl>> Decls;
+DeclList Parser::parse() {
+  DeclList Decls;
 
-  // Keep parsing until we hit EOF
-  while (!CurTok.is(tok::eof)) {
-    // Skip any stray closing braces - they're likely from a previous error
-    if (CurTok.is(tok::close_brace)) {
-      // Just consume them silently and move on
-      advance();
-      continue;
-    }
+  // Find the declaration boundaries first and fill in the bodies afterwards
+  bool WasLazy = LazyBodies;
+  LazyBodies |= ParallelBodies;
 
-    // Try to parse a top-level declaration
-    if (auto D = parseTopLevelDecl()) {
-      Decls.push_back(std::move(D));
-    } else {
-      // If we're looking at a '(' after a failed declaration, it's likely part
-      // of an invalid function
-      if (CurTok.is(tok::open_paren)) {
-        // Skip the entire parameter list
-        advance(); // consume '('
-        int ParenLevel = 1;
-
-        while (ParenLevel > 0 && !CurTok.is(tok::eof)) {
-          if (CurTok.is(tok::open_paren))
-            ParenLevel++;
-          else if (CurTok.is(tok::close_paren))
-            ParenLevel--;
-
-          advance();
+  // An error in the top-level pass is kept until the bodies before it have
+  // been parsed, as one of those may hold an earlier error
+  DiagnosticsEngine TopLevelDiags(Diags->getSourceMgr(), /*Deferring=*/true);
+  DiagnosticsEngine *WasDiags = Diags;
+  if (ParallelBodies)
+    Diags = &TopLevelDiags;
 
-          if (ParenLevel == 0)
-            break;
-        }
+  // Keep parsing until we hit EOF
+  while (!CurTok.is(tok::eof) && !TopLevelDiags.getFirstDeferred()) {
+    if (Decl *D = parseNextTopLevelDecl())
+      Decls.push_back(D);
+  }
 
-        // Now look for a function body if present
-        if (CurTok.is(tok::open_brace)) {
-          int BraceLevel = 1;
-          advance(); // consume '{'
+  Diags = WasDiags;
+  LazyBodies = WasLazy;
+  if (ParallelBodies)
+    parseBodiesInParallel(Decls, TopLevelDiags.getFirstDeferred());
+  return Decls;
+}
 
-          while (BraceLevel > 0 && !CurTok.is(tok::eof)) {
-            if (CurTok.is(tok::open_brace))
-              BraceLevel++;
-            else if (CurTok.is(tok::close_brace))
-              BraceLevel--;
+// Parse every lazy function body in Decls on worker threads, and report the
+// first error in the source among theirs and TopLevelError
+void Parser::parseBodiesInParallel(
+    ArrayRef<Decl *> Decls,
+    const std::optional<DiagnosticsEngine::DeferredDiagnostic> &TopLevelError) {
+  SmallVector<LazyFunctionBody *, 0> Bodies;
+  size_t TotalTokens = 0;
+  for (Decl *D : Decls) {
+    auto *FD = dyn_cast<FunctionDecl>(D);
+    LazyFunctionBody *Lazy = FD ? FD->getLazyBody() : nullptr;
+    if (!Lazy || Lazy->isParsed())
+      continue;
+    Bodies.push_back(Lazy);
+    TotalTokens += Lazy->getEndToken() - Lazy->getBeginToken();
+  }
+  if (Bodies.empty()) {
+    if (TopLevelError)
+      Diags->report(*TopLevelError);
+    return;
+  }
+
+  // Hand out runs of adjacent bodies of about equal token counts. A few runs
+  // per thread keep the threads busy when body sizes vary, while each run is
+  // large enough to make the per-run arena worth it.
+  struct Run {
+    size_t Begin, End;
+    ASTContext *Ctx;
+    std::unique_ptr<DiagnosticsEngine> Diags;
+  };
+  unsigned Threads = llvm::parallel::strategy.compute_thread_count();
+  size_t TokensPerRun = std::max<size_t>(TotalTokens / (4 * Threads), 1);
+  std::vector<Run> Runs;
+  size_t RunTokens = 0;
+  for (size_t I = 0, E = Bodies.size(); I != E; ++I) {
+    if (Runs.empty() || RunTokens >= TokensPerRun) {
+      Runs.push_back({I, I, &Ctx.createSubContext(),
+                      std::make_unique<DiagnosticsEngine>(
+                          Diags->getSourceMgr(), /*Deferring=*/true)});
+      RunTokens = 0;
+    }
+    Runs.back().End = I + 1;
+    RunTokens += Bodies[I]->getEndToken() - Bodies[I]->getBeginToken();
+  }
+  TINYCC_TRACE(Parser, "parsing " << Bodies.size() << " bodies in "
+                                  << Runs.size() << " runs on " << Threads
+                                  << " threads");
+
+  IdentifierTable &Idents = Lex.getIdentifierTable();
+  Idents.setConcurrent(true);
+  llvm::parallelForEach(Runs, [&](const Run &R) {
+    for (size_t I = R.Begin; I != R.End; ++I) {
+      Bodies[I]->set(parseBodyIn(*R.Ctx, *R.Diags, Bodies[I]->getBeginToken(),
+                                 Bodies[I]->getEndToken()));
+      if (R.Diags->getFirstDeferred())
+        break;
+    }
+  });
+  Idents.setConcurrent(false);
+
+  // Runs are in source order, so the first one with an error holds the first
+  // error in the bodies. Report it or the top-level error, whichever a serial
+  // parse would have stopped at.
+  const DiagnosticsEngine::DeferredDiagnostic *First =
+      TopLevelError ? &*TopLevelError : nullptr;
+  for (const Run &R : Runs) {
+    if (const auto &D = R.Diags->getFirstDeferred()) {
+      if (!First || D->Loc.getPointer() < First->Loc.getPointer())
+        First = &*D;
+      break;
+    }
+  }
+  if (First)
+    Diags->report(*First);
+}
 
-            advance();
+// Parse the next top-level declaration, recovering from errors
+Decl *Parser::parseNextTopLevelDecl() {
+  // Skip any stray closing braces - they're likely from a previous error
+  if (CurTok.is(tok::close_brace)) {
+    // Just consume them silently and move on
+    advance();
+    return nullptr;
+  }
 
-            if (BraceLevel == 0)
-              break;
-          }
-        }
-        // If there's a semicolon, consume it too
-        else if (CurTok.is(tok::semi)) {
-          advance();
-        }
+  // Try to parse a top-level declaration
+  if (auto D = parseTopLevelDecl()) {
+    return D;
+  } else {
+    // If we're looking at a '(' after a failed declaration, it's likely part
+    // of an invalid function
+    if (CurTok.is(tok::open_paren)) {
+      // Skip the entire parameter list
+      advance(); // consume '('
+      int ParenLevel = 1;
 
-        continue;
-      }
+      while (ParenLevel > 0 && !CurTok.is(tok::eof)) {
+        if (CurTok.is(tok::open_paren))
+          ParenLevel++;
+        else if (CurTok.is(tok::close_paren))
+          ParenLevel--;
 
-      // Error recovery: skip to the next semicolon or opening brace
-      while (!CurTok.is(tok::semi) && !CurTok.is(tok::open_brace) &&
-             !CurTok.is(tok::eof) && !CurTok.is(tok::close_brace)) {
         advance();
-      }
 
-      // If we found a semicolon, consume it
-      if (CurTok.is(tok::semi)) {
-        advance();
+        if (ParenLevel == 0)
+          break;
       }
 
-      // If we found an opening brace, try to consume until the matching closing
-      // brace
+      // Now look for a function body if present
       if (CurTok.is(tok::open_brace)) {
         int BraceLevel = 1;
-        advance(); // consume the opening brace
+        advance(); // consume '{'
 
         while (BraceLevel > 0 && !CurTok.is(tok::eof)) {
           if (CurTok.is(tok::open_brace))
@@ -110,19 +176,55 @@ std::vector<std::unique_ptr<Decl>> Parser::parse() {
 
           advance();
 
-          // If we've balanced out, we can stop
           if (BraceLevel == 0)
             break;
         }
       }
+      // If there's a semicolon, consume it too
+      else if (CurTok.is(tok::semi)) {
+        advance();
+      }
+
+      return nullptr;
+    }
+
+    // Error recovery: skip to the next semicolon or opening brace
+    while (!CurTok.is(tok::semi) && !CurTok.is(tok::open_brace) &&
+           !CurTok.is(tok::eof) && !CurTok.is(tok::close_brace)) {
+      advance();
+    }
+
+    // If we found a semicolon, consume it
+    if (CurTok.is(tok::semi)) {
+      advance();
+    }
+
+    // If we found an opening brace, try to consume until the matching closing
+    // brace
+    if (CurTok.is(tok::open_brace)) {
+      int BraceLevel = 1;
+      advance(); // consume the opening brace
+
+      while (BraceLevel > 0 && !CurTok.is(tok::eof)) {
+        if (CurTok.is(tok::open_brace))
+          BraceLevel++;
+        else if (CurTok.is(tok::close_brace))
+          BraceLevel--;
+
+        advance();
+
+        // If we've balanced out, we can stop
+        if (BraceLevel == 0)
+          break;
+      }
     }
   }
 
-  return Decls;
+  return nullptr;
 }
 
 // Parse top-level declarations
-std::unique_ptr<Decl> Parser::parseTopLevelDecl() {
+Decl *Parser::parseTopLevelDecl() {
   // Check for type keywords with wrong case
   if (checkKeywordCaseError()) {
     return parseTopLevelDecl();
@@ -130,16 +232,16 @@ std::unique_ptr<Decl> Parser::parseTopLevelDecl() {
 
   // For now, we only handle function declarations and global variables
   if (CurTok.is(tok::kw_int) || CurTok.is(tok::kw_void) || CurTok.is(tok::kw_float)) {
-    StringRef Type = CurTok.getIdentifier();
-    SMLoc TypeLoc = CurTok.getLocation();
+    StringRef Type = Lex.getSpelling(CurTok);
+    SMLoc TypeLoc = Lex.getLocation(CurTok);
     advance();
 
     // After a type specifier, we expect an identifier (variable or function name)
     if (!CurTok.is(tok::identifier)) {
       // If we see a constant, it's likely a malformed function declaration with a numeric name
       if (CurTok.is(tok::integer_cons)) {
-        StringRef ConstValue = CurTok.getIdentifier();
-        Diags.report(CurTok.getLocation(), diag::err_invalid_function_name, ConstValue);
+        StringRef ConstValue = Lex.getSpelling(CurTok);
+        Diags->report(Lex.getLocation(CurTok), diag::err_invalid_function_name, ConstValue);
 
         // Skip the constant token
         advance();
@@ -181,7 +283,7 @@ std::unique_ptr<Decl> Parser::parseTopLevelDecl() {
           }
         }
       } else {
-        Diags.report(CurTok.getLocation(), diag::err_expected, "identifier",
+        Diags->report(Lex.getLocation(CurTok), diag::err_expected, "identifier",
                      StringRef(CurTok.getName()));
       }
 
@@ -193,8 +295,8 @@ std::unique_ptr<Decl> Parser::parseTopLevelDecl() {
       return nullptr;
     }
 
-    StringRef Name = CurTok.getIdentifier();
-    SMLoc NameLoc = CurTok.getLocation();
+    IdentifierInfo *Name = Lex.getIdentifierInfo(CurTok);
+    SMLoc NameLoc = Lex.getLocation(CurTok);
     advance();
 
     // Check if it's a function declaration
@@ -203,9 +305,9 @@ std::unique_ptr<Decl> Parser::parseTopLevelDecl() {
       advance(); // consume '('
 
       // Parse parameter list
-      ParamList Params;
+      SmallVector<ParamDecl *, 8> Params;
       if (!CurTok.is(tok::close_paren)) {
-        Params = parseParamList();
+        parseParamList(Params);
       }
 
       if (!expect(tok::close_paren)) {
@@ -213,18 +315,19 @@ std::unique_ptr<Decl> Parser::parseTopLevelDecl() {
       }
       advance(); // consume ')'
 
-      auto Func = std::make_unique<FunctionDecl>(NameLoc, Name, Type, Params);
-
       // Check for function body
+      SmallVector<Stmt *, 16> Body;
       if (CurTok.is(tok::open_brace)) {
-        auto Body = parseCompoundStmt();
-        if (Body) {
-          Func->setBody(Body->getBody());
-        }
+        if (LazyBodies)
+          if (LazyFunctionBody *Lazy = skipFunctionBody())
+            return FunctionDecl::CreateLazy(Ctx, NameLoc, Name, Type, Params,
+                                            Lazy);
+        if (!parseBlockBody(Body))
+          Body.clear();
       } else if (CurTok.is(tok::semi)) {
         advance(); // consume ';'
       } else {
-        Diags.report(CurTok.getLocation(), diag::err_expected, "'{' or ';'",
+        Diags->report(Lex.getLocation(CurTok), diag::err_expected, "'{' or ';'",
                      StringRef(CurTok.getName()));
         // Try to recover by skipping to next declaration
         while (!CurTok.is(tok::semi) && !CurTok.is(tok::open_brace) &&
@@ -234,26 +337,24 @@ std::unique_ptr<Decl> Parser::parseTopLevelDecl() {
 
         // If we found a brace, try to parse function body
         if (CurTok.is(tok::open_brace)) {
-          auto Body = parseCompoundStmt();
-          if (Body) {
-            Func->setBody(Body->getBody());
-          }
+          if (!parseBlockBody(Body))
+            Body.clear();
         } else if (CurTok.is(tok::semi)) {
           advance(); // consume ';'
         }
       }
 
-      return Func;
+      return FunctionDecl::Create(Ctx, NameLoc, Name, Type, Params, Body);
     } else {
       // Variable declaration
-      auto Var = std::make_unique<VarDecl>(NameLoc, Name, Type);
+      auto Var = new (Ctx) VarDecl(NameLoc, Name, Type);
 
       // Check for initialization
       if (CurTok.is(tok::equal)) {
         advance(); // consume '='
         auto Init = parseExpr();
         if (Init)
-          Var->setInit(Init.release());
+          Var->setInit(Init);
       }
 
       if (!expect(tok::semi)) {
@@ -265,38 +366,34 @@ std::unique_ptr<Decl> Parser::parseTopLevelDecl() {
     }
   }
 
-  Diags.report(CurTok.getLocation(), diag::err_expected, "type specifier",
+  Diags->report(Lex.getLocation(CurTok), diag::err_expected, "type specifier",
                StringRef(CurTok.getName()));
   return nullptr;
 }
 
 // Parse parameter list for function declarations
-ParamList Parser::parseParamList() {
-  ParamList Params;
-
+void Parser::parseParamList(SmallVectorImpl<ParamDecl *> &Params) {
   do {
     auto Param = parseParamDecl();
     if (Param) {
-      Params.push_back(Param.release());
+      Params.push_back(Param);
     } else if (CurTok.is(tok::close_paren)) {
       break; // void parameter or error
     } else {
-      return Params; // Error recovery
+      return; // Error recovery
     }
   } while (consume(tok::comma));
-
-  return Params;
 }
 
 // Parse a single parameter declaration
-std::unique_ptr<ParamDecl> Parser::parseParamDecl() {
+ParamDecl *Parser::parseParamDecl() {
   if (!CurTok.is(tok::kw_int) && !CurTok.is(tok::kw_void)) {
-    Diags.report(CurTok.getLocation(), diag::err_expected, "type specifier",
+    Diags->report(Lex.getLocation(CurTok), diag::err_expected, "type specifier",
                  StringRef(CurTok.getName()));
     return nullptr;
   }
 
-  StringRef Type = CurTok.getIdentifier();
+  StringRef Type = Lex.getSpelling(CurTok);
   advance();
 
   // Special case for 'void' parameter (i.e., no parameters)
@@ -305,29 +402,81 @@ std::unique_ptr<ParamDecl> Parser::parseParamDecl() {
   }
 
   if (!CurTok.is(tok::identifier)) {
-    Diags.report(CurTok.getLocation(), diag::err_expected, "identifier",
+    Diags->report(Lex.getLocation(CurTok), diag::err_expected, "identifier",
                  StringRef(CurTok.getName()));
     return nullptr;
   }
 
-  StringRef Name = CurTok.getIdentifier();
-  SMLoc Loc = CurTok.getLocation();
+  IdentifierInfo *Name = Lex.getIdentifierInfo(CurTok);
+  SMLoc Loc = Lex.getLocation(CurTok);
   advance();
 
-  return std::make_unique<ParamDecl>(Loc, Name, Type);
+  return new (Ctx) ParamDecl(Loc, Name, Type);
 }
 
 // Parse compound statement (block)
-std::unique_ptr<CompoundStmt> Parser::parseCompoundStmt() {
-  if (!expect(tok::open_brace)) {
+CompoundStmt *Parser::parseCompoundStmt() {
+  SmallVector<Stmt *, 16> Body;
+  if (!parseBlockBody(Body))
     return nullptr;
+  return CompoundStmt::Create(Ctx, Body);
+}
+
+// Skip a function body by matching braces over the token kinds, without
+// building any AST. If the braces don't balance, nothing is consumed and
+// nullptr is returned so that a full parse can report the error.
+LazyFunctionBody *Parser::skipFunctionBody() {
+  const std::vector<uint8_t> &Kinds = Tokens->kinds();
+  size_t Begin = TokIdx;
+  unsigned Depth = 0;
+  for (size_t I = TokIdx, E = Kinds.size(); I != E; ++I) {
+    if (Kinds[I] == tok::open_brace) {
+      ++Depth;
+    } else if (Kinds[I] == tok::close_brace) {
+      if (--Depth == 0) {
+        TokIdx = I;
+        advance(); // consume '}'
+        void *Mem = Ctx.Allocate(sizeof(LazyFunctionBody),
+                                 alignof(LazyFunctionBody));
+        return new (Mem) LazyFunctionBody(this, Begin, TokIdx);
+      }
+    } else if (Kinds[I] == tok::eof) {
+      break;
+    }
+  }
+  return nullptr;
+}
+
+// Parse a body skipped by skipFunctionBody()
+ArrayRef<Stmt *> Parser::parseBody(uint32_t Begin, uint32_t End) {
+  return parseBodyIn(Ctx, *Diags, Begin, End);
+}
+
+// Parse the skipped body in tokens [Begin, End), allocating its nodes in C and
+// reporting errors to D
+ArrayRef<Stmt *> Parser::parseBodyIn(ASTContext &C, DiagnosticsEngine &D,
+                                     uint32_t Begin, uint32_t End) {
+  Parser P(Lex, *Tokens, D, C, Begin);
+  SmallVector<Stmt *, 16> Body;
+  // Parsing goes on after an error reported to a deferring engine, and error
+  // recovery can end the body early
+  if (!P.parseBlockBody(Body) || D.getFirstDeferred())
+    return {};
+  assert(P.TokIdx == End && "lazy body parsed past its end");
+  (void)End;
+  return C.copyArray<Stmt *>(Body);
+}
+
+// Parse the statements of a '{' ... '}' block into Body
+bool Parser::parseBlockBody(SmallVectorImpl<Stmt *> &Body) {
+  if (!expect(tok::open_brace)) {
+    return false;
   }
   advance(); // consume '{'
 
-  StmtList Body;
   while (!CurTok.is(tok::close_brace) && !CurTok.is(tok::eof)) {
     if (auto S = parseStmt()) {
-      Body.push_back(S.release());
+      Body.push_back(S);
     } else {
       // Skip to next statement for error recovery
       while (!CurTok.is(tok::semi) && !CurTok.is(tok::close_brace) &&
@@ -342,16 +491,16 @@ std::unique_ptr<CompoundStmt> Parser::parseCompoundStmt() {
   if (CurTok.is(tok::close_brace)) {
     advance(); // consume '}'
   } else {
-    Diags.report(CurTok.getLocation(), diag::err_expected, "}",
+    Diags->report(Lex.getLocation(CurTok), diag::err_expected, "}",
                  StringRef(CurTok.getName()));
-    return nullptr;
+    return false;
   }
 
-  return std::make_unique<CompoundStmt>(std::move(Body));
+  return true;
 }
 
 // Parse any statement
-std::unique_ptr<Stmt> Parser::parseStmt() {
+Stmt *Parser::parseStmt() {
   // Check for keywords with wrong case
   if (checkKeywordCaseError()) {
     return parseStmt();
@@ -359,23 +508,23 @@ std::unique_ptr<Stmt> Parser::parseStmt() {
 
   // Check for variable declarations
   if (CurTok.is(tok::kw_int) || CurTok.is(tok::kw_void)) {
-    StringRef Type = CurTok.getIdentifier();
-    SMLoc TypeLoc = CurTok.getLocation();
+    StringRef Type = Lex.getSpelling(CurTok);
+    SMLoc TypeLoc = Lex.getLocation(CurTok);
     advance();
 
     if (CurTok.is(tok::identifier)) {
-      StringRef Name = CurTok.getIdentifier();
-      SMLoc NameLoc = CurTok.getLocation();
+      IdentifierInfo *Name = Lex.getIdentifierInfo(CurTok);
+      SMLoc NameLoc = Lex.getLocation(CurTok);
       advance();
 
-      auto VD = std::make_unique<VarDecl>(NameLoc, Name, Type);
+      auto VD = new (Ctx) VarDecl(NameLoc, Name, Type);
 
       // Check for initialization
       if (CurTok.is(tok::equal)) {
         advance(); // consume '='
         auto Init = parseExpr();
         if (Init)
-          VD->setInit(Init.release());
+          VD->setInit(Init);
       }
 
       if (!expect(tok::semi)) {
@@ -384,10 +533,10 @@ std::unique_ptr<Stmt> Parser::parseStmt() {
       advance(); // consume ';'
 
       // Create a reference to the variable for the expression statement
-      auto VarRef = std::make_unique<VarRefExpr>(NameLoc, Name);
+      auto VarRef = new (Ctx) VarRefExpr(NameLoc, Name);
 
       // Return an expression statement with the variable reference
-      return std::make_unique<ExprStmt>(VarRef.release());
+      return new (Ctx) ExprStmt(VarRef);
     }
   }
 
@@ -403,11 +552,11 @@ std::unique_ptr<Stmt> Parser::parseStmt() {
 }
 
 // Parse return statement
-std::unique_ptr<ReturnStmt> Parser::parseReturnStmt() {
-  SMLoc Loc = CurTok.getLocation();
+ReturnStmt *Parser::parseReturnStmt() {
+  SMLoc Loc = Lex.getLocation(CurTok);
   advance(); // consume 'return'
 
-  std::unique_ptr<Expr> RetVal = nullptr;
+  Expr *RetVal = nullptr;
   if (!CurTok.is(tok::semi)) {
     RetVal = parseExpr();
   }
@@ -417,11 +566,11 @@ std::unique_ptr<ReturnStmt> Parser::parseReturnStmt() {
   }
   advance(); // consume ';'
 
-  return std::make_unique<ReturnStmt>(RetVal.release());
+  return new (Ctx) ReturnStmt(RetVal);
 }
 
 // Parse if statement
-std::unique_ptr<IfStmt> Parser::parseIfStmt() {
+IfStmt *Parser::parseIfStmt() {
   advance(); // consume 'if'
 
   if (!expect(tok::open_paren)) {
@@ -444,7 +593,7 @@ std::unique_ptr<IfStmt> Parser::parseIfStmt() {
     return nullptr;
   }
 
-  std::unique_ptr<Stmt> Else = nullptr;
+  Stmt *Else = nullptr;
   if (CurTok.is(tok::kw_else)) {
     advance(); // consume 'else'
     Else = parseStmt();
@@ -453,12 +602,11 @@ std::unique_ptr<IfStmt> Parser::parseIfStmt() {
     }
   }
 
-  return std::make_unique<IfStmt>(Cond.release(), Then.release(),
-                                  Else.release());
+  return new (Ctx) IfStmt(Cond, Then, Else);
 }
 
 // Parse expression statement (including assignments)
-std::unique_ptr<ExprStmt> Parser::parseExprStmt() {
+ExprStmt *Parser::parseExprStmt() {
   auto E = parseExpr();
   if (!E) {
     return nullptr;
@@ -469,145 +617,111 @@ std::unique_ptr<ExprStmt> Parser::parseExprStmt() {
   }
   advance(); // consume ';'
 
-  return std::make_unique<ExprStmt>(E.release());
+  return new (Ctx) ExprStmt(E);
 }
 
-// Parse expressions
-std::unique_ptr<Expr> Parser::parseExpr() {
-  return parseAssignExpr();
+namespace {
+// Binding powers of the binary operators, loosest first. Unknown (0) is below
+// every real level, so a token that isn't an operator ends an expression.
+enum Precedence : unsigned {
+  PrecUnknown = 0,
+  PrecAssignment,     // =
+  PrecEquality,       // (none yet)
+  PrecRelational,     // < >
+  PrecAdditive,       // + -
+  PrecMultiplicative, // * /
+};
+
+struct BinOpInfo {
+  Precedence Prec;
+  BinaryExpr::BinaryOpKind Opcode;
+};
+
+// Supporting another binary operator only takes an entry here (and a new
+// Precedence level if it needs one).
+constexpr std::array<BinOpInfo, tok::NUM_TOKENS> buildBinOpTable() {
+  std::array<BinOpInfo, tok::NUM_TOKENS> Table{};
+  Table[tok::equal] = {PrecAssignment, BinaryExpr::BO_Eq};
+  Table[tok::less] = {PrecRelational, BinaryExpr::BO_Lt};
+  Table[tok::greater] = {PrecRelational, BinaryExpr::BO_Gt};
+  Table[tok::plus] = {PrecAdditive, BinaryExpr::BO_Add};
+  Table[tok::minus] = {PrecAdditive, BinaryExpr::BO_Sub};
+  Table[tok::star] = {PrecMultiplicative, BinaryExpr::BO_Mul};
+  Table[tok::slash] = {PrecMultiplicative, BinaryExpr::BO_Div};
+  return Table;
 }
 
-// Parse assignment expressions
-std::unique_ptr<Expr> Parser::parseAssignExpr() {
-  auto LHS = parseEqualityExpr();
-  if (!LHS)
-    return nullptr;
-
-  if (CurTok.is(tok::equal)) {
-    SMLoc OpLoc = CurTok.getLocation();
-    advance(); // consume '='
+constexpr std::array<BinOpInfo, tok::NUM_TOKENS> BinOpTable =
+    buildBinOpTable();
 
-    auto RHS = parseAssignExpr();
-    if (!RHS)
-      return nullptr;
-
-    // Check if LHS is a variable reference
-    if (auto *VR = llvm::dyn_cast<VarRefExpr>(LHS.get())) {
-      // Create an assignment expression (using binary expression with BO_Eq)
-      return std::make_unique<BinaryExpr>(OpLoc, BinaryExpr::BO_Eq, LHS.release(), RHS.release());
-    }
-
-    Diags.report(OpLoc, diag::err_expected, "lvalue", "expression");
-    return nullptr;
-  }
-
-  return LHS;
-}
+bool isRightAssociative(Precedence Prec) { return Prec == PrecAssignment; }
+} // namespace
 
-// Parse equality expressions (==, !=)
-std::unique_ptr<Expr> Parser::parseEqualityExpr() {
-  auto E = parseRelationalExpr();
-  if (!E)
+// Parse expressions
+Expr *Parser::parseExpr() {
+  Expr *LHS = parseUnaryExpr();
+  if (!LHS)
     return nullptr;
-
-  // For now, we don't support equality operators yet
-  return E;
+  return parseBinOpRHS(LHS, PrecAssignment);
 }
 
-// Parse relational expressions (<, >, <=, >=)
-std::unique_ptr<Expr> Parser::parseRelationalExpr() {
-  auto E = parseAdditiveExpr();
-  if (!E)
-    return nullptr;
-
-  while (CurTok.is(tok::less) || CurTok.is(tok::greater) || CurTok.is(tok::equal)) {
-    BinaryExpr::BinaryOpKind Op;
-    if (CurTok.is(tok::less))
-      Op = BinaryExpr::BO_Lt;
-    else if (CurTok.is(tok::greater))
-      Op = BinaryExpr::BO_Gt;
-    else
-      Op = BinaryExpr::BO_Eq;
+// Parse the binary operators following LHS whose precedence is at least
+// MinPrec, by precedence climbing: each operand is parsed once, and recursion
+// only happens where an operator binds tighter than the one before it.
+Expr *Parser::parseBinOpRHS(Expr *LHS, unsigned MinPrec) {
+  while (true) {
+    BinOpInfo Op = BinOpTable[CurTok.getKind()];
+    if (Op.Prec < MinPrec)
+      return LHS;
 
-    SMLoc OpLoc = CurTok.getLocation();
+    SMLoc OpLoc = Lex.getLocation(CurTok);
     advance(); // consume the operator
 
-    auto RHS = parseAdditiveExpr();
-    if (!RHS)
-      return nullptr;
-
-    E = std::make_unique<BinaryExpr>(OpLoc, Op, E.release(), RHS.release());
-  }
-
-  return E;
-}
-
-// Parse additive expressions (+, -)
-std::unique_ptr<Expr> Parser::parseAdditiveExpr() {
-  auto E = parseMultiplicativeExpr();
-  if (!E)
-    return nullptr;
-
-  while (CurTok.is(tok::plus) || CurTok.is(tok::minus)) {
-    BinaryExpr::BinaryOpKind Op =
-        CurTok.is(tok::plus) ? BinaryExpr::BO_Add : BinaryExpr::BO_Sub;
-    SMLoc OpLoc = CurTok.getLocation();
-    advance(); // consume '+' or '-'
-
-    auto RHS = parseMultiplicativeExpr();
+    Expr *RHS = parseUnaryExpr();
     if (!RHS)
       return nullptr;
 
-    E = std::make_unique<BinaryExpr>(OpLoc, Op, E.release(), RHS.release());
-  }
-
-  return E;
-}
-
-// Parse multiplicative expressions (*, /)
-std::unique_ptr<Expr> Parser::parseMultiplicativeExpr() {
-  auto E = parseUnaryExpr();
-  if (!E)
-    return nullptr;
-
-  while (CurTok.is(tok::star) || CurTok.is(tok::slash)) {
-    BinaryExpr::BinaryOpKind Op =
-        CurTok.is(tok::star) ? BinaryExpr::BO_Mul : BinaryExpr::BO_Div;
-    SMLoc OpLoc = CurTok.getLocation();
-    advance(); // consume '*' or '/'
+    // Let a tighter operator (or, for right-associative ones, an equal one)
+    // take RHS as its left operand first.
+    Precedence NextPrec = BinOpTable[CurTok.getKind()].Prec;
+    bool RightAssoc = isRightAssociative(Op.Prec);
+    if (NextPrec > Op.Prec || (RightAssoc && NextPrec == Op.Prec)) {
+      RHS = parseBinOpRHS(RHS, RightAssoc ? Op.Prec : Op.Prec + 1);
+      if (!RHS)
+        return nullptr;
+    }
 
-    auto RHS = parseUnaryExpr();
-    if (!RHS)
+    // Assignment (represented as BO_Eq) needs a variable on the left
+    if (Op.Opcode == BinaryExpr::BO_Eq && !llvm::isa<VarRefExpr>(LHS)) {
+      Diags->report(OpLoc, diag::err_expected, "lvalue", "expression");
       return nullptr;
+    }
 
-    E = std::make_unique<BinaryExpr>(OpLoc, Op, E.release(), RHS.release());
+    LHS = new (Ctx) BinaryExpr(OpLoc, Op.Opcode, LHS, RHS);
   }
-
-  return E;
 }
 
 // Parse unary expressions (-, !)
-std::unique_ptr<Expr> Parser::parseUnaryExpr() {
+Expr *Parser::parseUnaryExpr() {
   if (CurTok.is(tok::minus)) {
-    SMLoc OpLoc = CurTok.getLocation();
+    SMLoc OpLoc = Lex.getLocation(CurTok);
     advance(); // consume '-'
 
     auto SubExpr = parseUnaryExpr();
     if (!SubExpr)
       return nullptr;
 
-    return std::make_unique<UnaryExpr>(OpLoc, UnaryExpr::UO_Minus,
-                                       SubExpr.release());
+    return new (Ctx) UnaryExpr(OpLoc, UnaryExpr::UO_Minus, SubExpr);
   }
 
   return parsePrimaryExpr();
 }
 
 // Parse primary expressions (identifiers, literals, parenthesized expressions)
-std::unique_ptr<Expr> Parser::parsePrimaryExpr() {
+Expr *Parser::parsePrimaryExpr() {
   if (CurTok.is(tok::identifier)) {
-    StringRef Name = CurTok.getIdentifier();
-    SMLoc Loc = CurTok.getLocation();
+    IdentifierInfo *Name = Lex.getIdentifierInfo(CurTok);
+    SMLoc Loc = Lex.getLocation(CurTok);
     advance();
 
     // Check if it's a function call
@@ -616,7 +730,7 @@ std::unique_ptr<Expr> Parser::parsePrimaryExpr() {
     }
 
     // Otherwise, it's a variable reference
-    return std::make_unique<VarRefExpr>(Loc, Name);
+    return new (Ctx) VarRefExpr(Loc, Name);
   } else if (CurTok.is(tok::integer_cons)) {
     return parseIntegerLiteral();
   } else if (CurTok.is(tok::float_cons)) {
@@ -636,49 +750,50 @@ std::unique_ptr<Expr> Parser::parsePrimaryExpr() {
     return E;
   }
 
-  Diags.report(CurTok.getLocation(), diag::err_expected, "expression",
+  Diags->report(Lex.getLocation(CurTok), diag::err_expected, "expression",
                StringRef(CurTok.getName()));
   return nullptr;
 }
 
 // Parse integer literal
-std::unique_ptr<Expr> Parser::parseIntegerLiteral() {
-  SMLoc Loc = CurTok.getLocation();
-  StringRef ValueStr = CurTok.getIdentifier();
+Expr *Parser::parseIntegerLiteral() {
+  SMLoc Loc = Lex.getLocation(CurTok);
+  StringRef ValueStr = Lex.getSpelling(CurTok);
 
   // Parse the integer value
   llvm::APInt Value(32, ValueStr.str(), 10);
   advance();
 
-  return std::make_unique<IntegerLiteral>(Loc, llvm::APSInt(Value));
+  return new (Ctx) IntegerLiteral(Loc, llvm::APSInt(Value));
 }
 
 // Parse float literal
-std::unique_ptr<Expr> Parser::parseFloatLiteral() {
-  SMLoc Loc = CurTok.getLocation();
-  StringRef ValueStr = CurTok.getIdentifier();
+Expr *Parser::parseFloatLiteral() {
+  SMLoc Loc = Lex.getLocation(CurTok);
+  StringRef ValueStr = Lex.getSpelling(CurTok);
 
   // Parse the float value - use standard C++ conversion to avoid LLVM API version issues
   float FloatValue = std::stof(ValueStr.str());
-  llvm::outs() << "Float value: " << FloatValue << "\n";
+  TINYCC_TRACE(Parser, "float literal '" << ValueStr << "' = " << FloatValue);
   llvm::APFloat Value(FloatValue);
 
   advance();
 
-  return std::make_unique<FloatLiteral>(Loc, Value);
+  return new (Ctx) FloatLiteral(Loc, Value);
 }
 
 // Parse function call
-std::unique_ptr<CallExpr> Parser::parseCallExpr(StringRef FuncName, SMLoc Loc) {
+CallExpr *Parser::parseCallExpr(IdentifierInfo *FuncName,
+                                                SMLoc Loc) {
   advance(); // consume '('
 
-  ExprList Args;
+  SmallVector<Expr *, 8> Args;
   if (!CurTok.is(tok::close_paren)) {
     // Parse argument list
     do {
       auto Arg = parseExpr();
       if (Arg) {
-        Args.push_back(Arg.release());
+        Args.push_back(Arg);
       } else {
         return nullptr;
       }
@@ -690,7 +805,7 @@ std::unique_ptr<CallExpr> Parser::parseCallExpr(StringRef FuncName, SMLoc Loc) {
   }
   advance(); // consume ')'
 
-  return std::make_unique<CallExpr>(Loc, FuncName, std::move(Args));
+  return CallExpr::Create(Ctx, Loc, FuncName, Args);
 }
 
 // Helper method to check for keyword case errors (e.g., "RETURN" instead of
@@ -699,20 +814,14 @@ bool Parser::checkKeywordCaseError() {
   if (!CurTok.is(tok::identifier))
     return false;
 
-  StringRef Id = CurTok.getIdentifier();
-
-  // Check all keywords by iterating through them
-  for (tok::TokenKind K = tok::kw_start; K <= tok::kw_end;
-       K = static_cast<tok::TokenKind>(K + 1)) {
-    const char *KwSpelling = tok::getKeywordSpelling(K);
-    if (KwSpelling && Id.equals_insensitive(KwSpelling) &&
-        Id.str() != KwSpelling) {
-      Diags.report(CurTok.getLocation(), diag::err_wrong_keyword_case, Id,
-                   KwSpelling);
-      advance(); // Skip this token
-      return true;
-    }
-  }
+  // One probe of the keyword perfect hash, whatever the number of keywords
+  StringRef Id = Lex.getSpelling(CurTok);
+  tok::TokenKind K = Keywords.getMiscasedKeyword(Id);
+  if (K == tok::unknown)
+    return false;
 
-  return false;
+  Diags->report(Lex.getLocation(CurTok), diag::err_wrong_keyword_case, Id,
+               tok::getKeywordSpelling(K));
+  advance(); // Skip this token
+  return true;
 }
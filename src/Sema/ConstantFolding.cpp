@@ -0,0 +1,355 @@
+#include "Sema/ConstantFolding.h"
+#include "AST/RecursiveASTVisitor.h"
+#include "AST/StmtVisitor.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/Casting.h"
+#include <optional>
+
+using namespace tinycc;
+
+namespace {
+
+// The type codegen gives a value: i32 for int, float for float. Unknown covers
+// void calls and names the pass can't see the declaration of.
+enum class ValueType { Unknown, Int, Float };
+
+ValueType getValueType(StringRef TypeName) {
+  if (TypeName == "int")
+    return ValueType::Int;
+  if (TypeName == "float")
+    return ValueType::Float;
+  return ValueType::Unknown;
+}
+
+// An expression after folding, with what the folder knows about it.
+struct FoldResult {
+  Expr *E = nullptr;
+  ValueType Type = ValueType::Unknown;
+  bool HasSideEffects = false;
+};
+
+bool isIntConstant(const Expr *E, bool One) {
+  auto *IL = dyn_cast<IntegerLiteral>(E);
+  return IL && (One ? IL->getValue().isOne() : IL->getValue().isZero());
+}
+
+// The value of a literal operand of a float operation.
+APFloat getFloatValue(const Expr *E) {
+  APFloat Value(APFloat::IEEEsingle());
+  if (auto *FL = dyn_cast<FloatLiteral>(E)) {
+    bool LosesInfo;
+    Value = FL->getValue();
+    Value.convert(APFloat::IEEEsingle(), APFloat::rmNearestTiesToEven,
+                  &LosesInfo);
+  } else {
+    Value.convertFromAPInt(cast<IntegerLiteral>(E)->getValue(),
+                           /*IsSigned=*/true, APFloat::rmNearestTiesToEven);
+  }
+  return Value;
+}
+
+APSInt makeInt(int64_t Value) { return APSInt(APInt(32, Value, true)); }
+
+// Folds Op on two int constants, or returns nothing if C leaves the result
+// undefined.
+std::optional<APSInt> foldIntBinary(BinaryExpr::BinaryOpKind Op,
+                                    const APSInt &L, const APSInt &R) {
+  bool Overflow = false;
+  APInt Result;
+  switch (Op) {
+  case BinaryExpr::BO_Add:
+    Result = L.sadd_ov(R, Overflow);
+    break;
+  case BinaryExpr::BO_Sub:
+    Result = L.ssub_ov(R, Overflow);
+    break;
+  case BinaryExpr::BO_Mul:
+    Result = L.smul_ov(R, Overflow);
+    break;
+  case BinaryExpr::BO_Div:
+    if (R.isZero())
+      return std::nullopt;
+    // C division truncates toward zero, as sdiv does; INT_MIN / -1 overflows.
+    Result = L.sdiv_ov(R, Overflow);
+    break;
+  case BinaryExpr::BO_Lt:
+    return makeInt(L.slt(R));
+  case BinaryExpr::BO_Gt:
+    return makeInt(L.sgt(R));
+  case BinaryExpr::BO_Eq:
+    return std::nullopt;
+  }
+  if (Overflow)
+    return std::nullopt;
+  return APSInt(Result);
+}
+
+// Folds the expressions of one AST bottom-up, replacing the operands of each
+// node with their folded form before trying to fold the node itself.
+class ExprFolder : public ExprVisitor<ExprFolder, FoldResult> {
+  ASTContext &C;
+  unsigned NumFolded = 0;
+
+  // Variables of the current function: its parameters and the int locals it
+  // declares. Globals are left out, as codegen doesn't resolve them in
+  // expressions.
+  DenseMap<const IdentifierInfo *, ValueType> Vars;
+
+  // Return types of the functions declared so far; as in codegen, a call
+  // resolves to the first declaration of its callee.
+  DenseMap<const IdentifierInfo *, ValueType> Functions;
+
+  // Returns the expression that replaces a folded one.
+  FoldResult replaceWith(const FoldResult &New) {
+    ++NumFolded;
+    return New;
+  }
+
+  FoldResult makeIntLiteral(SMLoc Loc, const APSInt &Value) {
+    return replaceWith(
+        {new (C) IntegerLiteral(Loc, Value), ValueType::Int, false});
+  }
+
+  FoldResult makeFloatLiteral(SMLoc Loc, const APFloat &Value) {
+    return replaceWith(
+        {new (C) FloatLiteral(Loc, Value), ValueType::Float, false});
+  }
+
+  FoldResult foldConstantBinary(BinaryExpr *BE) {
+    Expr *L = BE->getLeft(), *R = BE->getRight();
+    BinaryExpr::BinaryOpKind Op = BE->getOpcode();
+    if (auto *LI = dyn_cast<IntegerLiteral>(L))
+      if (auto *RI = dyn_cast<IntegerLiteral>(R)) {
+        if (std::optional<APSInt> Value =
+                foldIntBinary(Op, LI->getValue(), RI->getValue()))
+          return makeIntLiteral(BE->getLocation(), *Value);
+        return {};
+      }
+
+    APFloat LF = getFloatValue(L), RF = getFloatValue(R);
+    APFloat::cmpResult Cmp;
+    switch (Op) {
+    case BinaryExpr::BO_Add:
+      LF.add(RF, APFloat::rmNearestTiesToEven);
+      break;
+    case BinaryExpr::BO_Sub:
+      LF.subtract(RF, APFloat::rmNearestTiesToEven);
+      break;
+    case BinaryExpr::BO_Mul:
+      LF.multiply(RF, APFloat::rmNearestTiesToEven);
+      break;
+    case BinaryExpr::BO_Div:
+      // Division by zero gives an infinity or NaN, as it would at run time.
+      LF.divide(RF, APFloat::rmNearestTiesToEven);
+      break;
+    case BinaryExpr::BO_Lt:
+    case BinaryExpr::BO_Gt:
+      // Ordered comparisons, false if either side is NaN.
+      Cmp = LF.compare(RF);
+      return makeIntLiteral(
+          BE->getLocation(),
+          makeInt(Cmp == (Op == BinaryExpr::BO_Lt ? APFloat::cmpLessThan
+                                                  : APFloat::cmpGreaterThan)));
+    case BinaryExpr::BO_Eq:
+      return {};
+    }
+    return makeFloatLiteral(BE->getLocation(), LF);
+  }
+
+  // Drops an operation on ints that leaves one operand unchanged, or that
+  // multiplies by zero.
+  FoldResult simplifyIntBinary(BinaryExpr *BE, const FoldResult &L,
+                               const FoldResult &R) {
+    switch (BE->getOpcode()) {
+    case BinaryExpr::BO_Add:
+      if (isIntConstant(R.E, /*One=*/false))
+        return replaceWith(L);
+      if (isIntConstant(L.E, /*One=*/false))
+        return replaceWith(R);
+      break;
+    case BinaryExpr::BO_Sub:
+      if (isIntConstant(R.E, /*One=*/false))
+        return replaceWith(L);
+      break;
+    case BinaryExpr::BO_Mul:
+      if (isIntConstant(R.E, /*One=*/true))
+        return replaceWith(L);
+      if (isIntConstant(L.E, /*One=*/true))
+        return replaceWith(R);
+      if (isIntConstant(R.E, /*One=*/false) && !L.HasSideEffects)
+        return replaceWith(R);
+      if (isIntConstant(L.E, /*One=*/false) && !R.HasSideEffects)
+        return replaceWith(L);
+      break;
+    case BinaryExpr::BO_Div:
+      if (isIntConstant(R.E, /*One=*/true))
+        return replaceWith(L);
+      break;
+    default:
+      break;
+    }
+    return {};
+  }
+
+public:
+  explicit ExprFolder(ASTContext &C) : C(C) {}
+
+  unsigned getNumFolded() const { return NumFolded; }
+
+  void startFunction(FunctionDecl *FD) {
+    Functions.try_emplace(FD->getIdentifier(),
+                          getValueType(FD->getReturnType()));
+    Vars.clear();
+  }
+
+  void declareVar(const IdentifierInfo *Name, ValueType Type) {
+    Vars[Name] = Type;
+  }
+  bool isDeclared(const IdentifierInfo *Name) const {
+    return Vars.count(Name);
+  }
+
+  Expr *fold(Expr *E) { return visit(E).E; }
+
+  FoldResult visitIntegerLiteral(IntegerLiteral *IL) {
+    return {IL, ValueType::Int, false};
+  }
+
+  FoldResult visitFloatLiteral(FloatLiteral *FL) {
+    return {FL, ValueType::Float, false};
+  }
+
+  FoldResult visitVarRefExpr(VarRefExpr *VR) {
+    return {VR, Vars.lookup(VR->getIdentifier()), false};
+  }
+
+  FoldResult visitCallExpr(CallExpr *CE) {
+    ArrayRef<Expr *> Args = CE->getArgs();
+    for (unsigned I = 0, E = Args.size(); I != E; ++I)
+      CE->setArg(I, fold(Args[I]));
+    return {CE, Functions.lookup(CE->getCalleeIdentifier()), true};
+  }
+
+  FoldResult visitUnaryExpr(UnaryExpr *UE) {
+    FoldResult Sub = visit(UE->getSubExpr());
+    UE->setSubExpr(Sub.E);
+
+    if (auto *IL = dyn_cast<IntegerLiteral>(Sub.E)) {
+      const APSInt &Value = IL->getValue();
+      if (UE->getOpcode() == UnaryExpr::UO_Not)
+        return makeIntLiteral(UE->getLocation(), makeInt(Value.isZero()));
+      // -INT_MIN overflows.
+      if (!Value.isMinSignedValue())
+        return makeIntLiteral(UE->getLocation(), APSInt(-Value));
+    } else if (auto *FL = dyn_cast<FloatLiteral>(Sub.E)) {
+      APFloat Value = getFloatValue(FL);
+      if (UE->getOpcode() == UnaryExpr::UO_Not)
+        return makeIntLiteral(UE->getLocation(), makeInt(Value.isZero()));
+      Value.changeSign();
+      return makeFloatLiteral(UE->getLocation(), Value);
+    }
+
+    ValueType Type =
+        UE->getOpcode() == UnaryExpr::UO_Not ? ValueType::Int : Sub.Type;
+    return {UE, Type, Sub.HasSideEffects};
+  }
+
+  FoldResult visitBinaryExpr(BinaryExpr *BE) {
+    // The target of an assignment stays the variable it names.
+    if (BE->getOpcode() == BinaryExpr::BO_Eq) {
+      FoldResult R = visit(BE->getRight());
+      BE->setRight(R.E);
+      return {BE, R.Type, true};
+    }
+
+    FoldResult L = visit(BE->getLeft());
+    FoldResult R = visit(BE->getRight());
+    BE->setLeft(L.E);
+    BE->setRight(R.E);
+
+    bool IsConstant = isa<IntegerLiteral, FloatLiteral>(L.E) &&
+                      isa<IntegerLiteral, FloatLiteral>(R.E);
+    if (IsConstant) {
+      FoldResult Folded = foldConstantBinary(BE);
+      if (Folded.E)
+        return Folded;
+    }
+
+    if (L.Type == ValueType::Int && R.Type == ValueType::Int) {
+      FoldResult Simplified = simplifyIntBinary(BE, L, R);
+      if (Simplified.E)
+        return Simplified;
+    }
+
+    ValueType Type = ValueType::Unknown;
+    if (BE->getOpcode() == BinaryExpr::BO_Lt ||
+        BE->getOpcode() == BinaryExpr::BO_Gt)
+      Type = ValueType::Int;
+    else if (L.Type == ValueType::Float || R.Type == ValueType::Float)
+      Type = ValueType::Float;
+    else if (L.Type == ValueType::Int && R.Type == ValueType::Int)
+      Type = ValueType::Int;
+    return {BE, Type, L.HasSideEffects || R.HasSideEffects};
+  }
+};
+
+// Walks the declarations and statements, handing each expression they hold
+// to the ExprFolder.
+class ConstantFoldingPass : public RecursiveASTVisitor<ConstantFoldingPass> {
+  ExprFolder Folder;
+
+public:
+  explicit ConstantFoldingPass(ASTContext &C) : Folder(C) {}
+
+  unsigned getNumFolded() const { return Folder.getNumFolded(); }
+
+  // Expressions are folded whole by the node holding them.
+  bool traverseExpr(Expr *) { return true; }
+
+  bool visitFunctionDecl(FunctionDecl *FD) {
+    Folder.startFunction(FD);
+    return true;
+  }
+
+  bool visitParamDecl(ParamDecl *PD) {
+    Folder.declareVar(PD->getIdentifier(), getValueType(PD->getType()));
+    return true;
+  }
+
+  bool visitVarDecl(VarDecl *VD) {
+    if (VD->getInit())
+      VD->setInit(Folder.fold(VD->getInit()));
+    return true;
+  }
+
+  bool visitExprStmt(ExprStmt *S) {
+    // A reference to an unknown name on its own declares an int local; see
+    // CodeGenerator::visitExprStmt.
+    if (auto *VR = dyn_cast<VarRefExpr>(S->getExpr())) {
+      if (!Folder.isDeclared(VR->getIdentifier()))
+        Folder.declareVar(VR->getIdentifier(), ValueType::Int);
+      return true;
+    }
+    S->setExpr(Folder.fold(S->getExpr()));
+    return true;
+  }
+
+  bool visitReturnStmt(ReturnStmt *S) {
+    if (S->getRetVal())
+      S->setRetVal(Folder.fold(S->getRetVal()));
+    return true;
+  }
+
+  bool visitIfStmt(IfStmt *S) {
+    S->setCond(Folder.fold(S->getCond()));
+    return true;
+  }
+};
+
+} // namespace
+
+unsigned tinycc::foldConstants(ArrayRef<Decl *> Decls, ASTContext &C) {
+  ConstantFoldingPass Pass(C);
+  Pass.traverseAST(Decls);
+  return Pass.getNumFolded();
+}
@@ -0,0 +1,63 @@
+#include "Support/Trace.h"
+#include "llvm/ADT/SmallVector.h"
+#include <mutex>
+
+using namespace tinycc;
+
+std::atomic<unsigned> trace::detail::EnabledMask{0};
+
+namespace {
+const char *CategoryNames[] = {
+#define TRACE_CATEGORY(ID, Name) Name,
+#include "Support/TraceCategories.def"
+};
+
+struct Sink {
+  std::mutex Lock;
+  std::unique_ptr<llvm::raw_ostream> OS;
+
+  Sink()
+      : OS(std::make_unique<llvm::raw_fd_ostream>(2, /*shouldClose=*/false,
+                                                  /*unbuffered=*/false)) {}
+};
+
+Sink &getSink() {
+  static Sink S;
+  return S;
+}
+} // namespace
+
+bool trace::enable(llvm::StringRef Spec, llvm::StringRef &Unknown) {
+  llvm::SmallVector<llvm::StringRef, 4> Names;
+  Spec.split(Names, ',', /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+  unsigned Mask = 0;
+  for (llvm::StringRef Name : Names) {
+    Name = Name.trim();
+    if (Name == "all") {
+      Mask |= (1u << NumCategories) - 1;
+      continue;
+    }
+    unsigned I = 0;
+    while (I != NumCategories && Name != CategoryNames[I])
+      ++I;
+    if (I == NumCategories) {
+      Unknown = Name;
+      return false;
+    }
+    Mask |= 1u << I;
+  }
+  detail::EnabledMask.fetch_or(Mask, std::memory_order_relaxed);
+  return true;
+}
+
+void trace::setSink(std::unique_ptr<llvm::raw_ostream> OS) {
+  Sink &S = getSink();
+  std::lock_guard<std::mutex> Guard(S.Lock);
+  S.OS = std::move(OS);
+}
+
+trace::Line::~Line() {
+  Sink &S = getSink();
+  std::lock_guard<std::mutex> Guard(S.Lock);
+  *S.OS << '[' << CategoryNames[C] << "] " << Buffer << '\n';
+}
@@ -0,0 +1 @@
+int f(void) { return 1 + 2; }
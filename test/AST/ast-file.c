@@ -0,0 +1,27 @@
+// Code generated from an AST written with --emit-ast and read back with
+// --load-ast must match code generated straight from the source.
+// RUN: tinycc --codegen %s -o %t.direct.ll --emit-ast=%t.ast
+// RUN: tinycc --codegen --load-ast=%t.ast -o %t.loaded.ll
+// RUN: diff %t.direct.ll %t.loaded.ll
+// The nodes of Inputs/shared-node.c are Function, CompoundStmt, ReturnStmt,
+// Binary, IntegerLiteral 1 and IntegerLiteral 2. Pointing the Binary node's
+// RHS, at byte 96, at its LHS must be rejected rather than copied twice.
+// RUN: tinycc --codegen %S/Inputs/shared-node.c -o %t.shared.ll --emit-ast=%t.shared.ast
+// RUN: printf '\004' | dd of=%t.shared.ast bs=1 seek=96 conv=notrunc
+// RUN: not tinycc --codegen --load-ast=%t.shared.ast -o %t.shared-loaded.ll 2> %t.err
+// RUN: grep -q "node 3 is not in pre-order" %t.err
+
+int counter = 42;
+float scale = 2.5;
+
+int add(int a, int b) { return a + b; }
+
+int main(void) {
+  int x = 2 * 3 + 4;
+  if (x > 5) {
+    x = add(x, -1);
+  } else {
+    x = 0;
+  }
+  return x;
+}
@@ -0,0 +1,11 @@
+// f3 and f6 call sum with too few arguments, and --threads=4 generates them
+// in separate shards. Generating in one go stops at the call on line 7.
+
+int sum(int a, int b) { return a + b; }
+int f1(int a) { return sum(a, 1); }
+int f2(int a) { return sum(a, 2); }
+int f3(int a) { return sum(a); }
+int f4(int a) { return sum(a, 4); }
+int f5(int a) { return sum(a, 5); }
+int f6(int a) { return sum(a); }
+int f7(int a) { return sum(a, 7); }
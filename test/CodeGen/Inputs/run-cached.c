@@ -0,0 +1,7 @@
+int putchar(int c);
+
+int main(void) {
+  putchar(67);
+  putchar(10);
+  return 0;
+}
@@ -0,0 +1,46 @@
+// Stores, returns and call arguments convert between int and float as C
+// assignment does, truncating floats toward zero. Parameters can be
+// assigned to, and an if without an else can return from its then branch.
+// RUN: tinycc --codegen %s -o %t.ll
+// RUN: grep -q "fptosi float" %t.ll
+// RUN: grep -q "sitofp i32" %t.ll
+// RUN: tinycc --run %s
+
+int scale(int n) {
+  int x;
+  x = n * 1.5;
+  return x;
+}
+
+float widen(int n) {
+  return n;
+}
+
+int bump(int n, int limit) {
+  if (n > limit) {
+    return limit;
+  }
+  n = n + 1;
+  return n;
+}
+
+int main(void) {
+  int w;
+  if (scale(3) - 4) {
+    return 1;
+  }
+  w = widen(7) / 2 * 2;
+  if (w - 7) {
+    return 2;
+  }
+  if (scale(-3 + 0.75) + 3) {
+    return 3;
+  }
+  if (bump(5, 2) - 2) {
+    return 4;
+  }
+  if (bump(1, 2) - 2) {
+    return 5;
+  }
+  return 0;
+}
@@ -0,0 +1,13 @@
+// --emit selects the output file kind, and -target the triple to build for.
+// REQUIRES: x86-registered-target, aarch64-registered-target
+// RUN: tinycc --codegen --emit=asm -target x86_64-unknown-linux-gnu %s -o %t.s
+// RUN: grep -q "^answer:" %t.s
+// RUN: tinycc --codegen --emit=obj %s -o %t.o
+// RUN: llvm-objdump -t %t.o | grep -q answer
+// RUN: tinycc --codegen --emit=bc %s -o %t.bc
+// RUN: llvm-dis %t.bc -o %t.bc.ll
+// RUN: grep -q "define i32 @answer" %t.bc.ll
+// RUN: tinycc --codegen -target aarch64-linux-gnu %s -o %t.ll
+// RUN: grep -q 'target triple = "aarch64-unknown-linux-gnu"' %t.ll
+
+int answer(void) { return 6 * 7; }
@@ -0,0 +1,14 @@
+// Locals get their stack slots in the entry block, wherever they are
+// declared, and are promoted to registers even at -O0.
+// RUN: tinycc --codegen %s -o %t.ll
+// RUN: grep -q "phi i32" %t.ll
+// RUN: not grep -E "alloca|load|store" %t.ll
+
+int clamp(int n, int limit) {
+  if (n > limit) {
+    int excess;
+    excess = n - limit;
+    n = n - excess;
+  }
+  return n;
+}
@@ -0,0 +1,15 @@
+// -O selects the LLVM pipeline run over the module before it is written.
+// RUN: tinycc --codegen %s -o %t.O0.ll
+// RUN: grep -q "call i32 @add" %t.O0.ll
+// RUN: tinycc --codegen -O2 %s -o %t.O2.ll
+// RUN: grep -q "ret i32 5" %t.O2.ll
+
+int add(int a, int b) {
+  return a + b;
+}
+
+int main(void) {
+  int x;
+  x = add(2, 3);
+  return x;
+}
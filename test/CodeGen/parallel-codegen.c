@@ -0,0 +1,29 @@
+// Generating code in shards on several threads and linking them must give
+// the same module as generating it in one go, and report the same error when
+// several shards have one.
+// RUN: tinycc --codegen %s -o %t.serial.ll
+// RUN: tinycc --codegen --parallel-codegen --threads=4 %s -o %t.parallel.ll
+// RUN: diff %t.serial.ll %t.parallel.ll
+// RUN: not tinycc --codegen --parallel-codegen --threads=4 %S/Inputs/codegen-errors.c -o %t.errors.ll 2> %t.err
+// RUN: grep -q "codegen-errors.c:7:" %t.err
+
+int limit = 10;
+float scale = 0.5;
+
+int square(int a) { return a * a; }
+
+int sum(int a, int b) { return a + b; }
+
+int distance(int a, int b) {
+  int d;
+  if (a > b) {
+    d = a - b;
+  } else {
+    d = b - a;
+  }
+  return d;
+}
+
+int mix(int a, int b) { return sum(square(a), distance(a, b)) / 2; }
+
+int main(void) { return mix(3, 4) - 5; }
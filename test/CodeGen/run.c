@@ -0,0 +1,32 @@
+// --run compiles the input with the JIT and exits with what main returns.
+// Calls to declared functions resolve to the host's libc.
+// RUN: tinycc --run %s > %t.out
+// RUN: grep -q OK %t.out
+// RUN: rm -rf %t.cache
+// RUN: tinycc --run --jit-cache=%t.cache %s > %t.cached.out
+// RUN: diff %t.out %t.cached.out
+// RUN: ls %t.cache/*.o
+// A second run loads the cached object instead of compiling, so it runs
+// whatever object was put in its place
+// RUN: tinycc --codegen --emit=obj %S/Inputs/run-cached.c -o %t.other.o
+// RUN: cp %t.other.o %t.cache/*.o
+// RUN: tinycc --run --jit-cache=%t.cache %s > %t.reused.out
+// RUN: grep -qx C %t.reused.out
+// RUN: not grep -q OK %t.reused.out
+
+int putchar(int c);
+
+int fib(int n) {
+  if (n < 2) {
+    return n;
+  } else {
+    return fib(n - 1) + fib(n - 2);
+  }
+}
+
+int main(void) {
+  putchar(79);
+  putchar(75);
+  putchar(10);
+  return fib(10) - 55;
+}
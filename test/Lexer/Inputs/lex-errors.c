@@ -0,0 +1,7 @@
+// Lines 4 to 7 each have a lexing error, and --lex-chunk-size=16 puts each
+// in a chunk of its own.
+
+int first = 1 @;
+int second = 2 @;
+char *third = "unterminated;
+int fourth = 4 @;
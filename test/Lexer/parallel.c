@@ -0,0 +1,28 @@
+// Lexing in small chunks must give exactly the tokens of the serial lexer,
+// including around comments that span several would-be chunk boundaries.
+// RUN: tinycc --lex --dump-tokens %s > %t.serial
+// RUN: tinycc --lex --dump-tokens --parallel-lex --lex-chunk-size=16 %s > %t.parallel
+// RUN: diff %t.serial %t.parallel
+// RUN: tinycc --lex --dump-tokens --parallel-lex --lex-chunk-size=1 %s > %t.parallel1
+// RUN: diff %t.serial %t.parallel1
+// RUN: not tinycc --lex --parallel-lex --lex-chunk-size=16 %S/Inputs/lex-errors.c 2> %t.err
+// RUN: grep -q "lex-errors.c:4:" %t.err
+// RUN: sed -e 4,5d %S/Inputs/lex-errors.c > %t.string.c
+// RUN: not tinycc --lex --parallel-lex --lex-chunk-size=16 %t.string.c 2> %t.string.err
+// RUN: grep -q "string.c:4:15: error" %t.string.err
+
+int counter;
+
+/* A block comment long enough to cover several chunks.
+int not_a_token;
+   // a line comment inside a block comment
+int still_not_a_token; */
+
+int add(int a, int b) { // trailing comment /* not a block comment
+  return a + b / a;
+}
+
+/**/int after_empty_comment;
+int main(void) {
+  /* one-line */ return add(counter, counter);
+}
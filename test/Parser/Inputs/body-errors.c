@@ -0,0 +1,9 @@
+// The bodies of f2 and f4 have syntax errors, and --threads=4 parses them in
+// separate runs. A serial parse stops at the one on line 6.
+
+int f0(void) { return 0; }
+int f1(void) { return 1; }
+int f2(void) { return ); }
+int f3(void) { return 3; }
+int f4(void) { return ); }
+int f5(void) { return 5; }
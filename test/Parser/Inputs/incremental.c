@@ -0,0 +1,6 @@
+int f1(void) { return 1; }
+int f2(void) { return 2; }
+/* a note */
+int f3(void) { return 3; }
+int f4(void) { return 4; }
+int main(void) { return f1() + f4(); }
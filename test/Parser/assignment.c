@@ -0,0 +1,26 @@
+// Assignment binds loosest and groups to the right: a = b = 3 assigns 3 to
+// both, and x = 1 + 2 * 3 < 4 assigns the result of the comparison.
+// RUN: tinycc --run %s
+// RUN: tinycc --run --fold-constants=false %s
+
+int main(void) {
+  int a;
+  int b;
+  int x;
+  a = b = 3;
+  if (a - 3) {
+    return 1;
+  }
+  if (b - 3) {
+    return 2;
+  }
+  x = 1 + 2 * 3 < 4;
+  if (x) {
+    return 3;
+  }
+  x = 2 * 3 > 1 + 4;
+  if (x - 1) {
+    return 4;
+  }
+  return 0;
+}
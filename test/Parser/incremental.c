@@ -0,0 +1,21 @@
+// Edits applied by the incremental parser must give the tokens and decls of a
+// full parse of the edited text, and an edit that leaves an error must be
+// rejected with the error a full parse reports and the previous text kept.
+// RUN: tinycc --parse --segment-size=16 %S/Inputs/incremental.c \
+// RUN:   --edit="return 2=>return 20" \
+// RUN:   --edit="int f2=>/* int f2" \
+// RUN:   --edit="/* int f2=>int f2" \
+// RUN:   --edit="3; }=>3;" \
+// RUN:   --edit="\nint f3(void) { return 3; }=>" \
+// RUN:   --edit="return 4=>return \"4" \
+// RUN:   --edit="int main=>int f5(void) { return 5; }\nint main" \
+// RUN:   > %t.out 2> %t.err
+// RUN: grep -q "^edit 1: 5 decls in" %t.out
+// RUN: grep -q "^edit 2: 4 decls in" %t.out
+// RUN: grep -q "^edit 3: 5 decls in" %t.out
+// RUN: grep -q "^edit 4: rejected" %t.out
+// RUN: grep -q "incremental.c:5:7: error" %t.err
+// RUN: grep -q "^edit 5: 4 decls in" %t.out
+// RUN: grep -q "^edit 6: rejected" %t.out
+// RUN: grep -q "incremental.c:4:23: error" %t.err
+// RUN: grep -q "^edit 7: 5 decls in" %t.out
@@ -0,0 +1,28 @@
+// Function bodies skipped by --lazy-bodies are parsed when code generation
+// asks for them, and give the same module as a full parse.
+// RUN: tinycc --codegen %s -o %t.full.ll
+// RUN: tinycc --codegen --lazy-bodies %s -o %t.lazy.ll
+// RUN: diff %t.full.ll %t.lazy.ll
+
+int limit;
+
+void nothing(void) {
+}
+
+int clamp(int x, int hi) {
+  if (x > hi) {
+    return hi;
+  }
+  return x;
+}
+
+float scale(int x) {
+  return x * 0.5;
+}
+
+int main(void) {
+  int y;
+  nothing();
+  y = clamp(10, 4) + scale(3);
+  return y;
+}
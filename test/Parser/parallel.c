@@ -0,0 +1,47 @@
+// Parsing function bodies on worker threads must give the same module as a
+// serial parse, and report the same error when several bodies have one.
+// RUN: tinycc --codegen %s -o %t.serial.ll
+// RUN: tinycc --codegen --parallel-parse --threads=4 %s -o %t.parallel.ll
+// RUN: diff %t.serial.ll %t.parallel.ll
+// RUN: not tinycc --codegen --parallel-parse --threads=4 %S/Inputs/body-errors.c -o %t.errors.ll 2> %t.err
+// RUN: grep -q "body-errors.c:6:" %t.err
+// A top-level error after a body error, and one before it
+// RUN: sed -e "s/^int f3.*/int 3;/" %S/Inputs/body-errors.c > %t.after.c
+// RUN: not tinycc --codegen --parallel-parse --threads=4 %t.after.c -o %t.after.ll 2> %t.after.err
+// RUN: grep -q "after.c:6:" %t.after.err
+// RUN: sed -e "s/^int f1.*/int 1;/" %S/Inputs/body-errors.c > %t.before.c
+// RUN: not tinycc --codegen --parallel-parse --threads=4 %t.before.c -o %t.before.ll 2> %t.before.err
+// RUN: grep -q "before.c:5:" %t.before.err
+
+int counter;
+
+int square(int x) {
+  return x * x;
+}
+
+int max(int a, int b) {
+  if (a > b) {
+    return a;
+  } else {
+    return b;
+  }
+}
+
+float average(int a, int b) {
+  return (a + b) / 2.0;
+}
+
+int sumOfSquares(int a, int b) {
+  int s;
+  s = square(a) + square(b);
+  return s;
+}
+
+int main(void) {
+  int m;
+  m = max(sumOfSquares(1, 2), square(3));
+  if (m > 4) {
+    return m - 4;
+  }
+  return average(m, 3);
+}
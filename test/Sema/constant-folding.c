@@ -0,0 +1,21 @@
+// Constant expressions are folded before code generation, including in global
+// initializers, and identity operations on ints are dropped.
+// RUN: tinycc --codegen %s -o %t.ll
+// RUN: grep -q "@area = global i32 12" %t.ll
+// RUN: grep -q "@neg = global i32 -32" %t.ll
+// RUN: grep -q "@half = global float 5.000000e-01" %t.ll
+// RUN: grep -q "@whole = global i32 2" %t.ll
+// RUN: grep -q "ret i32 %a" %t.ll
+// RUN: grep -q "call i32 @same" %t.ll
+
+int area = 3 * 4;
+int neg = -(4 * 8);
+float half = 1.0 / 2;
+int whole = 2.75;
+
+int same(int a) { return (a * 1 + 0) / 1; }
+
+// The call stays: its result is multiplied by zero, but it has to run.
+int keep(int a) { return same(a) * 0; }
+
+int main(void) { return 2 * 3 + 4; }
@@ -38,6 +38,12 @@ llvm_config.add_tool_substitutions(
   ["tinycc"],
   config.bin_dir,
 )
+# Tests also use LLVM's own tools, e.g. not and llvm-dis
+llvm_config.with_environment("PATH", config.llvm_tools_dir, append_path=True)
+# Tests that need a particular backend say so with REQUIRES, as in LLVM's own
+# tests, e.g. REQUIRES: x86-registered-target
+for target in config.targets_to_build:
+    config.available_features.add(target.lower() + "-registered-target")
 # The LIT variable to hold the file extension for shared libraries (this is
 # platform dependent)
 config.substitutions.append(("%shlibext", config.llvm_shlib_ext))
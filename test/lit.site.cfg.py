@@ -0,0 +1 @@
+/tmp/build/test/lit.site.cfg.py
\ No newline at end of file
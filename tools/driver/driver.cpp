@@ -36,10 +36,12 @@ int main(int argc, const char **argv) {
   unsigned BufferID = SrcMgr.AddNewSourceBuffer(std::move(FileOrErr.get()), SMLoc());
 
   // Create lexer
-  Lexer Lex(SrcMgr, Diags);
+  IdentifierTable Idents;
+  Lexer Lex(SrcMgr, Diags, Idents);
 
   // Create parser
-  Parser P(Lex, Diags);
+  ASTContext Ctx;
+  Parser P(Lex, Diags, Ctx);
 
   // Parse top-level declarations
   auto Decls = P.parse();